@@ -12,6 +12,7 @@
 #include <i2c_t3.h>
 #include <stdio.h>
 #include <math.h>
+#include "debug.h"
 #include "state.h"
 
 // we have three coordinate systems here:
@@ -51,6 +52,22 @@ uint8_t AK8963::getStatusByte() {
     // (HXL~HZH) is read.
 }
 
+bool AK8963::MagSoftIron::verify() const {
+    for (uint8_t i = 0; i < 3; ++i) {
+        for (uint8_t j = 0; j < 3; ++j) {
+            if (!(fabsf(matrix(i, j)) <= 10.0f)) {
+                DebugPrint("Soft-iron matrix entries must be finite and within [-10, 10]");
+                return false;
+            }
+        }
+        if (!(matrix(i, i) > 0.0f)) {
+            DebugPrint("Soft-iron matrix must have a positive diagonal");
+            return false;
+        }
+    }
+    return true;
+}
+
 // writes values to state in milligauss
 bool AK8963::startMeasurement() {
     ready = false;
@@ -79,7 +96,8 @@ void AK8963::triggerCallback() {
         state->mag[0] = (float)magCount[0] * mRes - mag_bias.x;
         state->mag[1] = (float)magCount[1] * mRes - mag_bias.y;
         state->mag[2] = (float)magCount[2] * mRes - mag_bias.z;
-        rotate(state->R, state->mag);  // rotate to FLYER coords
+        mag_soft_iron.matrix.applyTo(state->mag);
+        state->R.applyTo(state->mag);  // rotate to FLYER coords
         state->updateStateMag();
     } else {
         // ERROR: ("ERROR: Magnetometer overflow!");
@@ -101,27 +119,11 @@ void AK8963::configure() {
     delay(10);
     i2c->readBytes(AK8963_ADDRESS, AK8963_ASAX, 3, &rawData[0]);  // Read the x-, y-, and z-axis sensitivity calibration values
     // adjustment formula is taken from the datasheet
-    magCalibration[0] = (float)(rawData[MAG_XDIR] - 128) / 256. + 1.;
-    magCalibration[1] = (float)(rawData[MAG_YDIR] - 128) / 256. + 1.;
-    magCalibration[2] = (float)(rawData[MAG_ZDIR] - 128) / 256. + 1.;
+    magCalibration[0] = (float)(rawData[MAG_XDIR] - 128) / 256.0f + 1.0f;
+    magCalibration[1] = (float)(rawData[MAG_YDIR] - 128) / 256.0f + 1.0f;
+    magCalibration[2] = (float)(rawData[MAG_ZDIR] - 128) / 256.0f + 1.0f;
     i2c->writeByte(AK8963_ADDRESS, AK8963_CNTL1, 0x00);  // Power down magnetometer
     delay(10);
     i2c->writeByte(AK8963_ADDRESS, AK8963_CNTL1, 0x16);  // Set magnetometer to 16bit, 100Hz continuous acquisition
     delay(10);
 }
-
-void AK8963::rotate(float R[3][3], float x[3]) {
-    /* R is [3][3] - [row][col], x is [3] */
-    float y[3] = {0.0, 0.0, 0.0};
-    float sum = 0.0;
-    for (uint8_t i = 0; i < 3; i++) {
-        sum = 0.0;
-        for (uint8_t j = 0; j < 3; j++) {
-            sum += R[i][j] * x[j];
-        }
-        y[i] = sum;
-    }
-    for (uint8_t i = 0; i < 3; i++) {
-        x[i] = y[i];
-    }
-}
@@ -14,6 +14,7 @@
 
 #include "Arduino.h"
 #include "i2cManager.h"
+#include "matrix.h"
 
 class State;
 
@@ -46,14 +47,20 @@ class AK8963 : public CallbackProcessor {
 
     static_assert(sizeof(MagBias) == 3 * 4, "Data is not packed");
 
+    // soft-iron correction, applied in IC/PCB coordinates after the bias is removed
+    struct __attribute__((packed)) MagSoftIron {
+        bool verify() const;
+        Matrix<float, 3, 3> matrix;  // ellipsoid fit of the raw samples, computed off-board
+    } mag_soft_iron;
+
+    static_assert(sizeof(MagSoftIron) == 3 * 3 * 4, "Data is not packed");
+
    private:
     State *state;
     I2CManager *i2c;
 
     uint8_t getStatusByte();
 
-    void rotate(float R[3][3], float x[3]);
-
     void reset();
     void configure();
     void disable();
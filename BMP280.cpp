@@ -9,6 +9,7 @@
 #include "BMP280.h"
 #include <math.h>
 #include <i2c_t3.h>
+#include "debug.h"
 #include "state.h"
 #include <stdint.h>
 
@@ -16,13 +17,25 @@ BMP280::BMP280(State *__state, I2CManager *__i2c) {
     state = __state;
     i2c = __i2c;
     ready = false;
+    phase = Phase::Idle;
+    conversionStart = 0;
 }
 
-void BMP280::restart() {
-    uint8_t settings;
+bool BMP280::Settings::verify() const {
+    if (pressure_oversampling < 1 || pressure_oversampling > 5 || temperature_oversampling < 1 || temperature_oversampling > 5) {
+        DebugPrint("Barometer oversampling codes must be within [1, 5]");
+        return false;
+    }
+    if (filter > 4) {
+        DebugPrint("Barometer filter code must be within [0, 4]");
+        return false;
+    }
+    return true;
+}
 
+void BMP280::restart() {
     // full reset
-    i2c->writeByte(BMP280_ADDR, 0xE0, 0xB6);
+    i2c->writeByte(BMP280_ADDR, BMP280_REG_RESET, 0xB6);
 
     delay(10);  // wait at least 2 ms for "power-on-reset"
     // load factory calibration
@@ -32,36 +45,43 @@ void BMP280::restart() {
         // ERROR: ("...WARNING -- CALIBRATION MAY NOT BE RELIABLE!...");
     }
 
-    // set controls to recommended values
-
-    // osrs_t[7,6,5] bits in control register 0xF4 -- 010 (x2)
-    // osrs_p[4,3,2] bits in control register 0xF4 -- 111 (x16)
-    //    mode[1,0] bits in control register 0xF4 --  11 (normal)
-    settings = 0x0;
-    settings |= OSRS_T_X2;
-    settings |= OSRS_P_X16;
-    settings |= MODE_NORMAL;
-    i2c->writeByte(BMP280_ADDR, BMP280_REG_CTRL_MEAS, settings);
-
-    //  t_sb[7,6,5] bits in control register 0xF5 -- 000 (0.5ms sleep)
-    // filter[4,3,2] bits in control register 0xF5 -- 111 (16)
-    //    ignore[1] bits in control register 0xF5 --   0 (ignore)
-    //  spi3w_en[0] bits in control register 0xF5 --   0 (disable)
-    settings = 0x0;
-    settings |= FILTER_X16;
-    settings |= T_SB_0p5ms;
-    i2c->writeByte(BMP280_ADDR, BMP280_REG_CONFIG, settings);
-
-    // resulting measurement rate is 26.32 Hz
-    delay(250);  // first few values are bad
+    // the sensor runs in forced mode: every measurement is a single conversion, after which it goes back to sleep
+    // run the first one blocking, since state is unhappy without an initial pressure
+    phase = Phase::Idle;
+    prepareTrigger();
+    i2c->writeByte(BMP280_ADDR, data_to_send[0], data_to_send[1]);
+    i2c->writeByte(BMP280_ADDR, data_to_send[2], data_to_send[3]);
+    delay((conversionTime() + 999) / 1000);
+    i2c->readBytes(BMP280_ADDR, BMP280_REG_STATUS, sizeof(data_to_read), data_to_read);
+    processResult(data_to_read + 4);
+    ready = true;
+}
+
+// datasheet section 3.8.1, maximum measurement time
+uint32_t BMP280::conversionTime() const {
+    return 1250 + 2300 * (1 << (settings.temperature_oversampling - 1)) + 2300 * (1 << (settings.pressure_oversampling - 1)) + 575;
+}
+
+void BMP280::prepareTrigger() {
+    //  t_sb[7,6,5] bits in control register 0xF5 -- unused in forced mode
+    // filter[4,3,2] bits in control register 0xF5
+    //  spi3w_en[0] bits in control register 0xF5 -- 0 (disable)
+    // osrs_t[7,6,5] bits in control register 0xF4
+    // osrs_p[4,3,2] bits in control register 0xF4
+    //    mode[1,0] bits in control register 0xF4 -- 01 (forced)
+    // config is only guaranteed to be written in sleep mode, which forced mode returns to after each conversion
+    data_to_send[0] = BMP280_REG_CONFIG;
+    data_to_send[1] = settings.filter << 2;
+    data_to_send[2] = BMP280_REG_CTRL_MEAS;
+    data_to_send[3] = (settings.temperature_oversampling << 5) | (settings.pressure_oversampling << 2) | MODE_FORCED;
 }
 
 uint8_t BMP280::getID() {
-    return i2c->readByte(BMP280_ADDR, 0xD0);  // Read WHO_AM_I register for BMP280 --> 0x58
+    return i2c->readByte(BMP280_ADDR, BMP280_REG_ID);  // Read WHO_AM_I register for BMP280 --> 0x58
 }
 
 uint8_t BMP280::getStatusByte() {
-    return i2c->readByte(BMP280_ADDR, 0xF3);
+    return i2c->readByte(BMP280_ADDR, BMP280_REG_STATUS);
     // bit 3 set to ‘1’ whenever a conversion is running and back to ‘0’ when the results have been transferred to the data registers.
     // bit 0 set to ‘1’ when the NVM data are being copied to image registers and back to ‘0’ when the copying is done.
 }
@@ -70,22 +90,52 @@ boolean BMP280::validateCalibation() {
     return (CALIBRATION.val.dig_T3 == -1000);
 }
 
-#define BMP280_REG_RESULT 0xF7  // 0xF7(msb) , 0xF8(lsb) , 0xF9(xlsb) : stores the pressure data.
-                                // 0xFA(msb) , 0xFB(lsb) , 0xFC(xlsb) : stores the temperature data.
 bool BMP280::startMeasurement(void) {
+    if (phase != Phase::Idle)
+        return false;
     ready = false;
-    data_to_send[0] = BMP280_REG_RESULT;
-    i2c->addTransfer(BMP280_ADDR, 1, data_to_send, 6, data_to_read, this);
+    phase = Phase::Triggering;
+    // register/value pairs can be written in a single burst
+    prepareTrigger();
+    i2c->addTransfer(BMP280_ADDR, 4, data_to_send, 0, data_to_read, this);
     return true;
 }
 
+void BMP280::pollMeasurement() {
+    if (phase != Phase::Converting || micros() - conversionStart < conversionTime())
+        return;
+    phase = Phase::Reading;
+    // reading from the status register brings ctrl_meas and the results along in one transfer
+    data_to_send[0] = BMP280_REG_STATUS;
+    i2c->addTransfer(BMP280_ADDR, 1, data_to_send, 10, data_to_read, this);
+}
+
 void BMP280::triggerCallback() {
+    switch (phase) {
+        case Phase::Triggering:
+            conversionStart = micros();
+            phase = Phase::Converting;
+            break;
+        case Phase::Reading:
+            if ((data_to_read[0] & STATUS_MEASURING) || ((data_to_read[1] & MODE_MASK) != MODE_SLEEP)) {
+                phase = Phase::Converting;  // not done yet, poll again
+                break;
+            }
+            processResult(data_to_read + 4);
+            phase = Phase::Idle;
+            ready = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void BMP280::processResult(const uint8_t *result) {
     int32_t rawP, rawT;
-    rawP = (((int32_t)data_to_read[0]) << 12) + (((int32_t)data_to_read[1]) << 4) + (((int32_t)data_to_read[2]) >> 4);
-    rawT = (((int32_t)data_to_read[3]) << 12) + (((int32_t)data_to_read[4]) << 4) + (((int32_t)data_to_read[5]) >> 4);
+    rawP = (((int32_t)result[0]) << 12) + (((int32_t)result[1]) << 4) + (((int32_t)result[2]) >> 4);
+    rawT = (((int32_t)result[3]) << 12) + (((int32_t)result[4]) << 4) + (((int32_t)result[5]) >> 4);
     state->temperature = compensate_T_int32(rawT);  // calculate temp first to update t_fine
-    state->pressure = compensate_P_int64(rawP);
-    ready = true;
+    state->pressure = compensate_P_int32(rawP);
 }
 
 // Returns temperature in DegC, resolution is 0.01 DegC. Output value of “5123” equals 51.23 DegC.
@@ -99,7 +149,11 @@ uint16_t BMP280::compensate_T_int32(int32_t rawT) {
     return T;  // noise ~ 0.004C
 }
 
-// Returns pressure in Pa. Output value of “96386” equals 96386 Pa = 963.86 hPa
+// Returns pressure in Pa as unsigned 32 bit integer in Q24.8 format (24 integer bits and 8 fractional bits), without 64 bit arithmetic.
+// Output value of “24674867” represents 24674867/256 = 96386.2 Pa = 963.862 hPa
+// The polynomial terms are the datasheet's 32 bit ones, but its truncating shifts around the division cost up to ~6 Pa;
+// the division is done in single precision instead, which the FPU does in one instruction.
+// bench/bmp280_compensation_check.cpp compares it with the datasheet's 64 bit reference.
 uint32_t BMP280::compensate_P_int32(int32_t rawP) {
     int32_t var1, var2;
     uint32_t p;
@@ -107,40 +161,14 @@ uint32_t BMP280::compensate_P_int32(int32_t rawP) {
     var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)CALIBRATION.val.dig_P6);
     var2 = var2 + ((var1 * ((int32_t)CALIBRATION.val.dig_P5)) << 1);
     var2 = (var2 >> 2) + (((int32_t)CALIBRATION.val.dig_P4) << 16);
-    var1 = (((CALIBRATION.val.dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((int32_t)CALIBRATION.val.dig_P2) * var1) >> 1)) >> 18;
-    var1 = ((((32768 + var1)) * ((int32_t)CALIBRATION.val.dig_P1)) >> 15);
-    if (var1 == 0) {
+    var1 = ((CALIBRATION.val.dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((int32_t)CALIBRATION.val.dig_P2) * var1) >> 1);
+    float divisor = (float)CALIBRATION.val.dig_P1 * (1.0f + (float)var1 * (1.0f / 8589934592.0f));  // var1 / 2^33
+    if (!(divisor > 0.0f)) {
         return 0;  // avoid exception caused by division by zero
     }
-    p = (((uint32_t)(((int32_t)1048576) - rawP) - (var2 >> 12))) * 3125;
-    if (p < 0x80000000) {
-        p = (p << 1) / ((uint32_t)var1);
-    } else {
-        p = (p / (uint32_t)var1) * 2;
-    }
+    float pressure = ((float)(((int32_t)1048576) - rawP) - (float)var2 * (1.0f / 4096.0f)) * 6250.0f / divisor;
+    p = (uint32_t)pressure;
     var1 = (((int32_t)CALIBRATION.val.dig_P9) * ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
     var2 = (((int32_t)(p >> 2)) * ((int32_t)CALIBRATION.val.dig_P8)) >> 13;
-    p = (uint32_t)((int32_t)p + ((var1 + var2 + CALIBRATION.val.dig_P7) >> 4));
-    return p;  // noise < 0.2pa
-}
-
-// Returns pressure in Pa as unsigned 32 bit integer in Q24.8 format (24 integer bits and 8 fractional bits).
-// Output value of “24674867” represents 24674867/256 = 96386.2 Pa = 963.862 hPa
-uint32_t BMP280::compensate_P_int64(int32_t rawP) {
-    int64_t var1, var2, p;
-    var1 = ((int64_t)t_fine) - 128000;
-    var2 = var1 * var1 * (int64_t)CALIBRATION.val.dig_P6;
-    var2 = var2 + ((var1 * (int64_t)CALIBRATION.val.dig_P5) << 17);
-    var2 = var2 + (((int64_t)CALIBRATION.val.dig_P4) << 35);
-    var1 = ((var1 * var1 * (int64_t)CALIBRATION.val.dig_P3) >> 8) + ((var1 * (int64_t)CALIBRATION.val.dig_P2) << 12);
-    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)CALIBRATION.val.dig_P1) >> 33;
-    if (var1 == 0) {
-        return 0;  // avoid exception caused by division by zero
-    }
-    p = 1048576 - rawP;
-    p = (((p << 31) - var2) * 3125) / var1;
-    var1 = (((int64_t)CALIBRATION.val.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
-    var2 = (((int64_t)CALIBRATION.val.dig_P8) * p) >> 19;
-    p = ((p + var1 + var2) >> 8) + (((int64_t)CALIBRATION.val.dig_P7) << 4);
-    return (uint32_t)p;
+    return (uint32_t)((int32_t)(pressure * 256.0f) + (var1 + var2 + CALIBRATION.val.dig_P7) * 16);
 }
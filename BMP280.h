@@ -48,27 +48,49 @@ class BMP280 : public CallbackProcessor {
 
     uint8_t getID();
 
-    bool startMeasurement();
-    void triggerCallback();  // handles return for getPT()
+    bool startMeasurement();  // triggers a forced mode conversion
+    void pollMeasurement();   // queues the result read once the conversion should have finished
+    void triggerCallback();   // handles return for both transfers
+
+    // oversampling and IIR filter settings, as datasheet register codes
+    struct __attribute__((packed)) Settings {
+        bool verify() const;
+        uint8_t pressure_oversampling;     // 1..5 -> x1, x2, x4, x8, x16
+        uint8_t temperature_oversampling;  // 1..5 -> x1, x2, x4, x8, x16
+        uint8_t filter;                    // 0..4 -> off, 2, 4, 8, 16
+    } settings;
+
+    static_assert(sizeof(Settings) == 3, "Data is not packed");
 
    private:
     State *state;
     I2CManager *i2c;
 
+    enum class Phase : uint8_t {
+        Idle,
+        Triggering,
+        Converting,
+        Reading,
+    } phase;
+
+    uint32_t conversionStart;
+    uint32_t conversionTime() const;  // maximum conversion time for the current settings, in us
+    void prepareTrigger();
+    void processResult(const uint8_t *result);
+
     uint8_t getStatusByte();
 
     BMP_calibration_union CALIBRATION;
     boolean validateCalibation();
 
     uint16_t compensate_T_int32(int32_t rawT);
-    uint32_t compensate_P_int32(int32_t rawP);
-    uint32_t compensate_P_int64(int32_t rawP);  // higher accuracy; 10x more computation; Q24.8 format
+    uint32_t compensate_P_int32(int32_t rawP);  // Q24.8 format; no 64 bit arithmetic
 
     int32_t t_fine;
 
     // buffers for processCallback
-    uint8_t data_to_read[6];
-    uint8_t data_to_send[1];
+    uint8_t data_to_read[10];  // status, ctrl_meas, config, reserved, pressure, temperature
+    uint8_t data_to_send[4];
 };
 
 #define BMP280_ADDR 0x77  // 7-bit address
@@ -104,6 +126,9 @@ class BMP280 : public CallbackProcessor {
 #define MODE_SLEEP 0x00
 #define MODE_FORCED 0x01
 #define MODE_NORMAL 0x03
+#define MODE_MASK 0x03
+
+#define STATUS_MEASURING 0x08
 
 #define FILTER_OFF 0x00
 #define FILTER_X2 0x04
@@ -12,7 +12,10 @@
 #include <i2c_t3.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 #include "board.h"
+#include "debug.h"
+#include "fastmath.h"
 #include "state.h"
 
 // we have three coordinate systems here:
@@ -37,13 +40,51 @@
 #define GYRO_YSIGN 1
 #define GYRO_ZSIGN 1  // verified by experiment
 
+namespace {
+// a measured sample rate can fall below twice a configured filter frequency; keep the design valid
+float belowNyquist(float frequency, float sample_rate) {
+    return fminf(frequency, 0.45f * sample_rate);
+}
+}
+
 MPU9250::MPU9250(State *__state, I2CManager *__i2c) {
     state = __state;
     i2c = __i2c;
     ready = false;
+    filter_rate = MPU9250_SAMPLE_RATE;
     pinMode(board::MPU_INTERRUPT, INPUT);
 }
 
+bool MPU9250::Settings::verify() const {
+    bool ok{true};
+    if (gyro_filter < 1 || gyro_filter > 6 || accel_filter > 7) {
+        DebugPrint("Gyro DLPF code must be within [1, 6] and accel DLPF code within [0, 7]");
+        ok = false;
+    }
+    if (gyro_range > 3 || accel_range > 3) {
+        DebugPrint("Gyro and accel range codes must be within [0, 3]");
+        ok = false;
+    }
+    const float nyquist = MPU9250_SAMPLE_RATE * 0.5f;
+    if (!(gyro_lowpass >= 0.0f && gyro_lowpass < nyquist)) {
+        DebugPrint("Gyro low pass cutoff must be within [0, 500) Hz");
+        ok = false;
+    }
+    if (!(notch_min >= 0.0f && notch_min <= notch_max && notch_max < nyquist)) {
+        DebugPrint("Gyro notch centers must satisfy 0 <= min <= max < 500 Hz");
+        ok = false;
+    }
+    if (!(notch_q > 0.0f && notch_q <= 100.0f)) {
+        DebugPrint("Gyro notch Q must be within (0, 100]");
+        ok = false;
+    }
+    if (notch_source > 1) {
+        DebugPrint("Gyro notch source must be 0 (motor output) or 1 (vibration peak)");
+        ok = false;
+    }
+    return ok;
+}
+
 uint8_t MPU9250::getID() {
     return i2c->readByte(MPU9250_ADDRESS, WHO_AM_I);  // Read WHO_AM_I register for MPU-9250 --> 0x71
 }
@@ -69,7 +110,7 @@ void MPU9250::correctBiasValues()  // all in FLYER system
     for (uint8_t i = 0; i < 3; i++) {
         recipNorm += state->accel_filter[i] * state->accel_filter[i];
     }
-    recipNorm = invSqrt(recipNorm);
+    recipNorm = inv_sqrt(recipNorm);
     ax = state->accel_filter[0] * recipNorm;
     ay = state->accel_filter[1] * recipNorm;
     az = state->accel_filter[2] * recipNorm;
@@ -109,7 +150,7 @@ void MPU9250::correctBiasValues()  // all in FLYER system
         qy = -ax;
         // qz = 0;
 
-        recipNorm = invSqrt(qw * qw + qx * qx + qy * qy);
+        recipNorm = inv_sqrt(qw * qw + qx * qx + qy * qy);
         qw *= recipNorm;
         qx *= recipNorm;
         qy *= recipNorm;
@@ -119,17 +160,11 @@ void MPU9250::correctBiasValues()  // all in FLYER system
     // note: qz = 0.
     // we also want this to be the inverse/transpose to take us from ax ay az back to 0 0 -1
 
-    state->R[0][0] = 1 - 2 * qy * qy;
-    state->R[1][0] = 2 * qx * qy;
-    state->R[2][0] = 2 * qy * qw;
-
-    state->R[0][1] = 2 * qx * qy;
-    state->R[1][1] = 1 - 2 * qx * qx;
-    state->R[2][1] = -2 * qx * qw;
-
-    state->R[0][2] = -2 * qy * qw;
-    state->R[1][2] = 2 * qx * qw;
-    state->R[2][2] = 1 - 2 * qx * qx - 2 * qy * qy;
+    state->R = Matrix<float, 3, 3>{{
+        {1 - 2 * qy * qy, 2 * qx * qy, -2 * qy * qw},
+        {2 * qx * qy, 1 - 2 * qx * qx, 2 * qx * qw},
+        {2 * qy * qw, -2 * qx * qw, 1 - 2 * qx * qx - 2 * qy * qy},
+    }};
 
     // the bias correction in the IC/PCB coordinates
     accelBias[0] = state->accel_filter[0] - ax;
@@ -147,18 +182,7 @@ void MPU9250::forgetBiasValues() {
         gyroBias[i] = 0.0f;
         accelBias[i] = 0.0f;
     }
-    // set R to identity
-    state->R[0][0] = 1.0f;
-    state->R[0][1] = 0.0f;
-    state->R[0][2] = 0.0f;
-
-    state->R[1][0] = 0.0f;
-    state->R[1][1] = 1.0f;
-    state->R[1][2] = 0.0f;
-
-    state->R[2][0] = 0.0f;
-    state->R[2][1] = 0.0f;
-    state->R[2][2] = 1.0f;
+    state->R = Matrix<float, 3, 3>::identity();
 }
 
 // writes values to state in g's and in degrees per second
@@ -198,12 +222,19 @@ void MPU9250::triggerCallback() {
     state->accel[0] = (float)accelCount[0] * aRes - accelBias[0];
     state->accel[1] = (float)accelCount[1] * aRes - accelBias[1];
     state->accel[2] = (float)accelCount[2] * aRes - accelBias[2];
-    rotate(state->R, state->accel);  // rotate to FLYER coords
+    state->R.applyTo(state->accel);  // rotate to FLYER coords
 
     state->gyro[0] = (float)gyroCount[0] * gRes - gyroBias[0];
     state->gyro[1] = (float)gyroCount[1] * gRes - gyroBias[1];
     state->gyro[2] = (float)gyroCount[2] * gRes - gyroBias[2];
-    rotate(state->R, state->gyro);  // rotate to FLYER coords
+    state->R.applyTo(state->gyro);  // rotate to FLYER coords
+    for (uint8_t i = 0; i < 3; i++)
+        gyroUnfiltered[i] = state->gyro[i];
+
+    if (applied_settings.gyro_lowpass > 0.0f)
+        gyroLowPass.apply(state->gyro);
+    if (applied_settings.notch_min > 0.0f)
+        gyroNotch.apply(state->gyro);
 
     ready = true;
 }
@@ -292,6 +323,54 @@ void MPU9250::setFilters(uint8_t gyrofilter, uint8_t accelfilter) {
     }
 }
 
+void MPU9250::updateFilters(float vibration_peak, float sample_rate) {
+    // the blocking register writes and the range switch would land under samples in flight, so wait for disarm
+    if (!state->is(STATUS_ENABLED) && memcmp(&settings, &applied_settings, sizeof(Settings)))
+        configureSensors();
+
+    // until the first measurement assume the loop keeps up with the sensor
+    if (!(sample_rate > 0.0f))
+        sample_rate = MPU9250_SAMPLE_RATE;
+    if (fabsf(sample_rate - filter_rate) > MPU9250_FILTER_RATE_TOLERANCE * filter_rate) {
+        filter_rate = sample_rate;
+        if (applied_settings.gyro_lowpass > 0.0f)
+            gyroLowPass.setCoefficients(BiquadCoefficients::lowPass(belowNyquist(applied_settings.gyro_lowpass, filter_rate), filter_rate, 0.70710678f));
+    }
+
+    if (applied_settings.notch_min > 0.0f) {
+        float center;
+        if (applied_settings.notch_source == 1) {
+            // the peak was found in bins of the measured rate; designing at that same rate puts the notch on the bin
+            center = constrain(vibration_peak, applied_settings.notch_min, applied_settings.notch_max);
+        } else {
+            // motor output is the best proxy for motor speed that we have
+            uint32_t output{0};
+            for (uint8_t i = 0; i < 8; ++i)
+                output += state->MotorOut[i];
+            center = applied_settings.notch_min + (applied_settings.notch_max - applied_settings.notch_min) * output * (1.0f / (8.0f * 4095.0f));
+        }
+        gyroNotch.setCoefficients(BiquadCoefficients::notch(belowNyquist(center, sample_rate), sample_rate, applied_settings.notch_q));
+    }
+}
+
+void MPU9250::configureSensors() {
+    setFilters(settings.gyro_filter, settings.accel_filter);
+    // full scale select is in bits [4:3] of both registers
+    i2c->writeByte(MPU9250_ADDRESS, GYRO_CONFIG, settings.gyro_range << 3);
+    i2c->writeByte(MPU9250_ADDRESS, ACCEL_CONFIG, settings.accel_range << 3);
+    gRes = (250 << settings.gyro_range) / 32768.0f;
+    aRes = (2 << settings.accel_range) / 32768.0f;
+
+    if (settings.gyro_lowpass > 0.0f)
+        gyroLowPass.setCoefficients(BiquadCoefficients::lowPass(belowNyquist(settings.gyro_lowpass, filter_rate), filter_rate, 0.70710678f));
+    if (settings.notch_min > 0.0f)
+        gyroNotch.setCoefficients(BiquadCoefficients::notch(belowNyquist(settings.notch_min, filter_rate), filter_rate, settings.notch_q));
+    gyroLowPass.reset();
+    gyroNotch.reset();
+
+    applied_settings = settings;
+}
+
 void MPU9250::configure() {
     // wake up device
     i2c->writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x00);  // Clear sleep mode bit (6), enable all sensors
@@ -300,15 +379,9 @@ void MPU9250::configure() {
     // get stable time source
     i2c->writeByte(MPU9250_ADDRESS, PWR_MGMT_1, 0x01);  // Set clock source to be PLL with x-axis gyroscope reference, bits 2:0 = 001
     // there's no downside to updating the registers at the internal sample rate of 1kHz (even though we read more slowly)
-    i2c->writeByte(MPU9250_ADDRESS, SMPLRT_DIV, 0x00);
-    // set up the FIFO, ext. SYNC and set gyro filter to 184Hz lowpass / 1kHz output rate (before SMPLRT_DIV)
-    i2c->writeByte(MPU9250_ADDRESS, MPU9250_CONFIG, 0x01);
-    // Set gyroscope to +/-1000dps resolutions and enable the low pass filter for gyro and temp
-    i2c->writeByte(MPU9250_ADDRESS, GYRO_CONFIG, 0x10);
-    // Set accelerometer to +/-8g resolution
-    i2c->writeByte(MPU9250_ADDRESS, ACCEL_CONFIG, 0x10);  // 0x00=+/-2g; Ox08=+/-4g;0x10=+/-8g,0x18=+/-16g
-    // Set accelerometer to 5Hz low pass / 1kHz output rate (before SMPLRT_DIV)
-    i2c->writeByte(MPU9250_ADDRESS, ACCEL_CONFIG2, 0x06);
+    i2c->writeByte(MPU9250_ADDRESS, SMPLRT_DIV, MPU9250_SAMPLE_RATE_DIVIDER);
+    // low pass filters and ranges, from settings
+    configureSensors();
     // Configure Interrupts and Bypass Enable
     // Set interrupt pin active high, push-pull, enable I2C_BYPASS_EN so additional chips
     // can join the I2C bus and all can be controlled by the Arduino as master
@@ -317,29 +390,3 @@ void MPU9250::configure() {
     i2c->writeByte(MPU9250_ADDRESS, INT_PIN_CFG, 0x32);  // clear interrupt by any read operation
     i2c->writeByte(MPU9250_ADDRESS, INT_ENABLE, 0x01);   // Enable data ready (bit 0) interrupt
 }
-
-void MPU9250::rotate(float R[3][3], float x[3]) {
-    /* R is [3][3] - [row][col], x is [3] */
-    float y[3] = {0.0, 0.0, 0.0};
-    float sum = 0.0;
-    for (uint8_t i = 0; i < 3; i++) {
-        sum = 0.0;
-        for (uint8_t j = 0; j < 3; j++) {
-            sum += R[i][j] * x[j];
-        }
-        y[i] = sum;
-    }
-    for (uint8_t i = 0; i < 3; i++) {
-        x[i] = y[i];
-    }
-}
-
-float MPU9250::invSqrt(float x) {
-    float halfx = 0.5f * x;
-    float y = x;
-    long i = *(long *)&y;
-    i = 0x5f3759df - (i >> 1);
-    y = *(float *)&i;
-    y = y * (1.5f - (halfx * y * y));
-    return y;
-}
@@ -13,6 +13,7 @@
 #define MPU9250_h
 
 #include "Arduino.h"
+#include "biquad.h"
 #include "i2cManager.h"
 
 class State;
@@ -37,33 +38,61 @@ class MPU9250 : public CallbackProcessor {
     void triggerCallback();  // handles return for getAccelGryo()
 
     float getTemp() {
-        return (float)temperatureCount[0] / 333.87 + 21.0;
+        return (float)temperatureCount[0] / 333.87f + 21.0f;
     }
 
     uint8_t getID();
 
     void setFilters(uint8_t gyrofilter, uint8_t accelfilter);
 
+    // reconfigures the sensor after a settings change while disarmed and retunes the software filters
+    void updateFilters(float vibration_peak, float sample_rate);  // strongest measured gyro vibration and measured sample rate, in Hz; 0 if not known yet
+
+    const float *getUnfilteredGyro() const {  // last sample before the software filters, in FLYER coords
+        return gyroUnfiltered;
+    }
+
+    struct __attribute__((packed)) Settings {
+        bool verify() const;
+        uint8_t gyro_filter;   // on-chip gyro DLPF code, see setFilters; 1..6, the modes with 1kHz output
+        uint8_t accel_filter;  // on-chip accel DLPF code, see setFilters
+        uint8_t gyro_range;    // 0..3 -> +/- 250, 500, 1000, 2000 deg/s
+        uint8_t accel_range;   // 0..3 -> +/- 2, 4, 8, 16 g
+        float gyro_lowpass;    // software gyro low pass cutoff in Hz; 0 disables it
+        float notch_min;       // software gyro notch center at zero motor output, in Hz; 0 disables it
+        float notch_max;       // software gyro notch center at full motor output, in Hz
+        float notch_q;         // notch quality factor, center / bandwidth
+        uint8_t notch_source;  // 0: notch follows motor output, 1: notch follows the measured vibration peak
+    } settings;
+
+    static_assert(sizeof(Settings) == 4 + 4 * 4 + 1, "Data is not packed");
+
    private:
     State *state;
     I2CManager *i2c;
 
+    Settings applied_settings;  // what the sensor and filters are currently set up for
+    void configureSensors();    // applies settings to the sensor and the software filters
+
+    float filter_rate;  // sample rate the software filters are designed for, in Hz
+
+    Biquad<3> gyroLowPass;
+    Biquad<3> gyroNotch;
+
     bool dataReadyInterrupt();  // check interrupt
     uint8_t getStatusByte();
 
-    void rotate(float R[3][3], float x[3]);
-
     void reset();
     void configure();  // set up filters and resolutions for flight
 
-    float invSqrt(float x);
-    const float aRes = 8.0 / 32768.0;     // +/- 8g
-    const float gRes = 1000.0 / 32768.0;  // +/- 1000 deg/s
+    float aRes = 8.0f / 32768.0f;     // g per LSB, set by accel_range
+    float gRes = 1000.0f / 32768.0f;  // deg/s per LSB, set by gyro_range
 
     // 16-bit raw values, bias correction, factory calibration
     int16_t temperatureCount[1] = {0};
     int16_t gyroCount[3] = {0, 0, 0}, accelCount[3] = {0, 0, 0};
     float gyroBias[3] = {0.0, 0.0, 0.0}, accelBias[3] = {0.0, 0.0, 0.0};
+    float gyroUnfiltered[3] = {0.0f, 0.0f, 0.0f};
 
     // buffers for processCallback
     uint8_t data_to_read[14];
@@ -73,6 +102,14 @@ class MPU9250 : public CallbackProcessor {
 
 #define DEG2RAD 0.01745329251f
 
+// with the DLPF enabled (gyro_filter 1..6) the sensor outputs 1kHz / (1 + SMPLRT_DIV)
+#define MPU9250_SAMPLE_RATE_DIVIDER 0
+#define MPU9250_SAMPLE_RATE (1000.0f / (1 + MPU9250_SAMPLE_RATE_DIVIDER))
+
+// the loop can read fewer samples than the sensor outputs; the software filters are redesigned
+// when the measured rate moves further than this fraction from the one they were designed for
+#define MPU9250_FILTER_RATE_TOLERANCE 0.02f
+
 //*************************************************************
 //
 // MPU Registers (See Table 1 Register Map on page 7)
@@ -1,26 +1,68 @@
 #include "ahrs.h"
 
 #include <math.h>
+#include "fastmath.h"
 
-float _inv_sqrt(float x);
+namespace {
 
-/* IMU algorithm update */
+/*
+ * Normalize a measurement vector in place
+ * Returns false for an all-zero (invalid) measurement, which would give NaN
+ */
+bool normalize(float& x, float& y, float& z) {
+    if ((x == 0.0f) && (y == 0.0f) && (z == 0.0f))
+        return false;
+    float recipNorm = inv_sqrt(x * x + y * y + z * z);
+    x *= recipNorm;
+    y *= recipNorm;
+    z *= recipNorm;
+    return true;
+}
+
+void normalize_quaternion(float q[4]) {
+    float recipNorm = inv_sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    q[0] *= recipNorm;
+    q[1] *= recipNorm;
+    q[2] *= recipNorm;
+    q[3] *= recipNorm;
+}
+
+/*
+ * Reference direction of Earth's magnetic field, [bx, 0, bz], for a
+ * normalized magnetometer measurement taken at attitude q
+ */
+void magnetic_reference(float mx, float my, float mz, const float q[4], float& bx, float& bz) {
+    float q0q1 = q[0] * q[1];
+    float q0q2 = q[0] * q[2];
+    float q0q3 = q[0] * q[3];
+    float q1q1 = q[1] * q[1];
+    float q1q2 = q[1] * q[2];
+    float q1q3 = q[1] * q[3];
+    float q2q2 = q[2] * q[2];
+    float q2q3 = q[2] * q[3];
+    float q3q3 = q[3] * q[3];
+
+    float hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+    float hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+    bx = sqrtf(hx * hx + hy * hy);
+    bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+}
 
-void se_madgwick_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, float beta, float q[4]) {
-    float recipNorm;
+/*
+ * Single Madgwick step with a normalized magnetometer measurement and its
+ * precomputed reference (_2bx, _2bz)
+ *
+ * The accelerometer and magnetometer gradients are normalized separately and
+ * the latter is weighted by mag_weight, so the heading correction has its own
+ * rate, mag_weight * beta, independent of the tilt error
+ */
+void madgwick_step_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float _2bx, float _2bz, float delta_time, float beta, float mag_weight, float q[4]) {
+    float recipNorm, sNormSq;
     float s0, s1, s2, s3;
+    float m0, m1, m2, m3;
+    float fax, fay, faz, fmx, fmy, fmz;
     float qDot1, qDot2, qDot3, qDot4;
-    float hx, hy;
-    float _2q0mx, _2q0my, _2q0mz, _2q1mx, _2bx, _2bz, _4bx, _4bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3, q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
-
-    /*
-     * Use IMU algorithm if magnetometer measurement is invalid
-     * (avoids NaN in magnetometer normalization)
-     */
-    if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
-        se_madgwick_ahrs_update_imu(gx, gy, gz, ax, ay, az, delta_time, beta, q);
-        return;
-    }
+    float _4bx, _4bz, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
 
     /* Rate of change of quaternion from gyroscope */
     qDot1 = 0.5f * (-q[1] * gx - q[2] * gy - q[3] * gz);
@@ -28,35 +70,15 @@ void se_madgwick_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax
     qDot3 = 0.5f * (q[0] * gy - q[1] * gz + q[3] * gx);
     qDot4 = 0.5f * (q[0] * gz + q[1] * gy - q[2] * gx);
 
-    /*
-     * Compute feedback only if accelerometer measurement is valid
-     * (avoids NaN in accelerometer normalization)
-     */
-    if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
-        /* Normalize accelerometer measurement */
-        recipNorm = _inv_sqrt(ax * ax + ay * ay + az * az);
-        ax *= recipNorm;
-        ay *= recipNorm;
-        az *= recipNorm;
-
-        /* Normalize magnetometer measurement */
-        recipNorm = _inv_sqrt(mx * mx + my * my + mz * mz);
-        mx *= recipNorm;
-        my *= recipNorm;
-        mz *= recipNorm;
-
+    /* Compute feedback only if accelerometer measurement is valid */
+    if (normalize(ax, ay, az)) {
         /* Auxiliary variables to avoid repeated arithmetic */
-        _2q0mx = 2.0f * q[0] * mx;
-        _2q0my = 2.0f * q[0] * my;
-        _2q0mz = 2.0f * q[0] * mz;
-        _2q1mx = 2.0f * q[1] * mx;
         _2q0 = 2.0f * q[0];
         _2q1 = 2.0f * q[1];
         _2q2 = 2.0f * q[2];
         _2q3 = 2.0f * q[3];
         _2q0q2 = 2.0f * q[0] * q[2];
         _2q2q3 = 2.0f * q[2] * q[3];
-        q0q0 = q[0] * q[0];
         q0q1 = q[0] * q[1];
         q0q2 = q[0] * q[2];
         q0q3 = q[0] * q[3];
@@ -66,32 +88,45 @@ void se_madgwick_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax
         q2q2 = q[2] * q[2];
         q2q3 = q[2] * q[3];
         q3q3 = q[3] * q[3];
-
-        /* Reference direction of Earth's magnetic field */
-        hx = mx * q0q0 - _2q0my * q[3] + _2q0mz * q[2] + mx * q1q1 + _2q1 * my * q[2] + _2q1 * mz * q[3] - mx * q2q2 - mx * q3q3;
-        hy = _2q0mx * q[3] + my * q0q0 - _2q0mz * q[1] + _2q1mx * q[2] - my * q1q1 + my * q2q2 + _2q2 * mz * q[3] - my * q3q3;
-        _2bx = sqrt(hx * hx + hy * hy);
-        _2bz = -_2q0mx * q[2] + _2q0my * q[1] + mz * q0q0 + _2q1mx * q[3] - mz * q1q1 + _2q2 * my * q[3] - mz * q2q2 + mz * q3q3;
         _4bx = 2.0f * _2bx;
         _4bz = 2.0f * _2bz;
 
-        /* Gradient decent algorithm corrective step */
-        s0 = -_2q2 * (2.0f * q1q3 - _2q0q2 - ax) + _2q1 * (2.0f * q0q1 + _2q2q3 - ay) - _2bz * q[2] * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) +
-             (-_2bx * q[3] + _2bz * q[1]) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q[2] * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-        s1 = _2q3 * (2.0f * q1q3 - _2q0q2 - ax) + _2q0 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q[1] * (1 - 2.0f * q1q1 - 2.0f * q2q2 - az) +
-             _2bz * q[3] * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q[2] + _2bz * q[0]) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) +
-             (_2bx * q[3] - _4bz * q[1]) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-        s2 = -_2q0 * (2.0f * q1q3 - _2q0q2 - ax) + _2q3 * (2.0f * q0q1 + _2q2q3 - ay) - 4.0f * q[2] * (1 - 2.0f * q1q1 - 2.0f * q2q2 - az) +
-             (-_4bx * q[2] - _2bz * q[0]) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) + (_2bx * q[1] + _2bz * q[3]) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) +
-             (_2bx * q[0] - _4bz * q[2]) * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-        s3 = _2q1 * (2.0f * q1q3 - _2q0q2 - ax) + _2q2 * (2.0f * q0q1 + _2q2q3 - ay) + (-_4bx * q[3] + _2bz * q[1]) * (_2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx) +
-             (-_2bx * q[0] + _2bz * q[2]) * (_2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my) + _2bx * q[1] * (_2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz);
-        recipNorm = _inv_sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
-        /* Normalize step magnitude */
-        s0 *= recipNorm;
-        s1 *= recipNorm;
-        s2 *= recipNorm;
-        s3 *= recipNorm;
+        /* Objective functions: estimated minus measured direction of gravity and magnetic field */
+        fax = 2.0f * q1q3 - _2q0q2 - ax;
+        fay = 2.0f * q0q1 + _2q2q3 - ay;
+        faz = 1 - 2.0f * q1q1 - 2.0f * q2q2 - az;
+        fmx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+        fmy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+        fmz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+        /* Gradient decent algorithm corrective step, accelerometer part */
+        s0 = -_2q2 * fax + _2q1 * fay;
+        s1 = _2q3 * fax + _2q0 * fay - 4.0f * q[1] * faz;
+        s2 = -_2q0 * fax + _2q3 * fay - 4.0f * q[2] * faz;
+        s3 = _2q1 * fax + _2q2 * fay;
+        /* Normalize step magnitude; a zero gradient (estimate already matches the measurement) has no direction and would give NaN */
+        sNormSq = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+        if (sNormSq > 0.0f) {
+            recipNorm = inv_sqrt(sNormSq);
+            s0 *= recipNorm;
+            s1 *= recipNorm;
+            s2 *= recipNorm;
+            s3 *= recipNorm;
+        }
+
+        /* Magnetometer part */
+        m0 = -_2bz * q[2] * fmx + (-_2bx * q[3] + _2bz * q[1]) * fmy + _2bx * q[2] * fmz;
+        m1 = _2bz * q[3] * fmx + (_2bx * q[2] + _2bz * q[0]) * fmy + (_2bx * q[3] - _4bz * q[1]) * fmz;
+        m2 = (-_4bx * q[2] - _2bz * q[0]) * fmx + (_2bx * q[1] + _2bz * q[3]) * fmy + (_2bx * q[0] - _4bz * q[2]) * fmz;
+        m3 = (-_4bx * q[3] + _2bz * q[1]) * fmx + (-_2bx * q[0] + _2bz * q[2]) * fmy + _2bx * q[1] * fmz;
+        sNormSq = m0 * m0 + m1 * m1 + m2 * m2 + m3 * m3;
+        if (sNormSq > 0.0f) {
+            recipNorm = mag_weight * inv_sqrt(sNormSq);
+            s0 += m0 * recipNorm;
+            s1 += m1 * recipNorm;
+            s2 += m2 * recipNorm;
+            s3 += m3 * recipNorm;
+        }
 
         /* Apply feedback step */
         qDot1 -= beta * s0;
@@ -106,16 +141,11 @@ void se_madgwick_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax
     q[2] += qDot3 * delta_time;
     q[3] += qDot4 * delta_time;
 
-    /* Normalize quaternion */
-    recipNorm = _inv_sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
-    q[0] *= recipNorm;
-    q[1] *= recipNorm;
-    q[2] *= recipNorm;
-    q[3] *= recipNorm;
+    normalize_quaternion(q);
 }
 
-void se_madgwick_ahrs_update_imu(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, float beta, float q[4]) {
-    float recipNorm;
+void madgwick_step(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, float beta, float q[4]) {
+    float recipNorm, sNormSq;
     float s0, s1, s2, s3;
     float qDot1, qDot2, qDot3, qDot4;
     float _2q0, _2q1, _2q2, _2q3, _4q0, _4q1, _4q2, _8q1, _8q2;
@@ -127,17 +157,8 @@ void se_madgwick_ahrs_update_imu(float gx, float gy, float gz, float ax, float a
     qDot3 = 0.5f * (q[0] * gy - q[1] * gz + q[3] * gx);
     qDot4 = 0.5f * (q[0] * gz + q[1] * gy - q[2] * gx);
 
-    /*
-*Compute feedback only if accelerometer measurement valid
-*(avoids NaN in accelerometer normalisation)
-*/
-    if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
-        // Normalise accelerometer measurement
-        recipNorm = _inv_sqrt(ax * ax + ay * ay + az * az);
-        ax *= recipNorm;
-        ay *= recipNorm;
-        az *= recipNorm;
-
+    /* Compute feedback only if accelerometer measurement is valid */
+    if (normalize(ax, ay, az)) {
         // Auxiliary variables to avoid repeated arithmetic
         _2q0 = 2.0f * q[0];
         _2q1 = 2.0f * q[1];
@@ -158,18 +179,21 @@ void se_madgwick_ahrs_update_imu(float gx, float gy, float gz, float ax, float a
         s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q[1] - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
         s2 = 4.0f * q0q0 * q[2] + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
         s3 = 4.0f * q1q1 * q[3] - _2q1 * ax + 4.0f * q2q2 * q[3] - _2q2 * ay;
-        /* normalize step magnitude */
-        recipNorm = _inv_sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
-        s0 *= recipNorm;
-        s1 *= recipNorm;
-        s2 *= recipNorm;
-        s3 *= recipNorm;
-
-        /* Apply feedback step */
-        qDot1 -= beta * s0;
-        qDot2 -= beta * s1;
-        qDot3 -= beta * s2;
-        qDot4 -= beta * s3;
+        /* Normalize step magnitude; a zero gradient (estimate already matches the measurement) has no direction and would give NaN */
+        sNormSq = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+        if (sNormSq > 0.0f) {
+            recipNorm = inv_sqrt(sNormSq);
+            s0 *= recipNorm;
+            s1 *= recipNorm;
+            s2 *= recipNorm;
+            s3 *= recipNorm;
+
+            /* Apply feedback step */
+            qDot1 -= beta * s0;
+            qDot2 -= beta * s1;
+            qDot3 -= beta * s2;
+            qDot4 -= beta * s3;
+        }
     }
 
     /* Integrate rate of change of quaternion to yield quaternion */
@@ -178,92 +202,30 @@ void se_madgwick_ahrs_update_imu(float gx, float gy, float gz, float ax, float a
     q[2] += qDot3 * delta_time;
     q[3] += qDot4 * delta_time;
 
-    /* Normalise quaternion */
-    recipNorm = _inv_sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
-    q[0] *= recipNorm;
-    q[1] *= recipNorm;
-    q[2] *= recipNorm;
-    q[3] *= recipNorm;
+    normalize_quaternion(q);
 }
 
-void se_mahony_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, float ki_2, float kp_2, float fb_i[3], float q[4]) {
-    float recipNorm;
-    float q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
-    float hx, hy, bx, bz;
-    float halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
-    float halfex, halfey, halfez;
+/*
+ * Apply Mahony feedback for the error (halfex, halfey, halfez) to the
+ * gyroscope rate and integrate it into q
+ */
+void mahony_integrate(float gx, float gy, float gz, bool has_feedback, float halfex, float halfey, float halfez, float delta_time, float ki_2, float kp_2, float fb_i[3], float q[4]) {
     float qa, qb, qc;
 
-    /*
-     * Use IMU algorithm if magnetometer measurement is invalid
-     * (avoids NaN in magnetometer normalization)
-     */
-    if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
-        se_mahony_ahrs_update_imu(gx, gy, gz, ax, ay, az, delta_time, ki_2, kp_2, fb_i, q);
-        return;
-    }
-
-    /*
-     * Compute feedback only if accelerometer measurement is valid
-     * (avoids NaN in accelerometer normalization)
-     */
-    if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
-        /* Normalise accelerometer measurement */
-        recipNorm = _inv_sqrt(ax * ax + ay * ay + az * az);
-        ax *= recipNorm;
-        ay *= recipNorm;
-        az *= recipNorm;
-
-        /* Normalise magnetometer measurement */
-        recipNorm = _inv_sqrt(mx * mx + my * my + mz * mz);
-        mx *= recipNorm;
-        my *= recipNorm;
-        mz *= recipNorm;
-
-        /* Auxiliary variables to avoid repeated arithmetic */
-        q0q0 = q[0] * q[0];
-        q0q1 = q[0] * q[1];
-        q0q2 = q[0] * q[2];
-        q0q3 = q[0] * q[3];
-        q1q1 = q[1] * q[1];
-        q1q2 = q[1] * q[2];
-        q1q3 = q[1] * q[3];
-        q2q2 = q[2] * q[2];
-        q2q3 = q[2] * q[3];
-        q3q3 = q[3] * q[3];
-
-        /* Reference direction of Earth's magnetic field */
-        hx = 2.0f * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
-        hy = 2.0f * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
-        bx = sqrt(hx * hx + hy * hy);
-        bz = 2.0f * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
-
-        /* Estimated direction of gravity and magnetic field */
-        halfvx = q1q3 - q0q2;
-        halfvy = q0q1 + q2q3;
-        halfvz = q0q0 - 0.5f + q3q3;
-        halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
-        halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
-        halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
-
-        /*
-         * Error is sum of cross product between estimated direction and measured
-         * direction of field vectors
-         */
-        halfex = (ay * halfvz - az * halfvy) + (my * halfwz - mz * halfwy);
-        halfey = (az * halfvx - ax * halfvz) + (mz * halfwx - mx * halfwz);
-        halfez = (ax * halfvy - ay * halfvx) + (mx * halfwy - my * halfwx);
-
+    if (has_feedback) {
         /* Compute and apply integral feedback if enabled */
         if (ki_2 > 0.0f) {
-            fb_i[0] += ki_2 * halfex * delta_time; /* integral error scaled by Ki */
+            /* integral error scaled by Ki */
+            fb_i[0] += ki_2 * halfex * delta_time;
             fb_i[1] += ki_2 * halfey * delta_time;
             fb_i[2] += ki_2 * halfez * delta_time;
-            gx += fb_i[0]; /* apply integral feedback */
+            /* apply integral feedback */
+            gx += fb_i[0];
             gy += fb_i[1];
             gz += fb_i[2];
         } else {
-            fb_i[0] = 0.0f; /* prevent integral windup */
+            /* prevent integral windup */
+            fb_i[0] = 0.0f;
             fb_i[1] = 0.0f;
             fb_i[2] = 0.0f;
         }
@@ -275,7 +237,8 @@ void se_mahony_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax,
     }
 
     /* Integrate rate of change of quaternion */
-    gx *= 0.5f * delta_time; /* pre-multiply common factors */
+    /* pre-multiply common factors */
+    gx *= 0.5f * delta_time;
     gy *= 0.5f * delta_time;
     gz *= 0.5f * delta_time;
     qa = q[0];
@@ -286,111 +249,291 @@ void se_mahony_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax,
     q[2] += qa * gy - qb * gz + q[3] * gx;
     q[3] += qa * gz + qb * gy - qc * gx;
 
-    /* Normalize quaternion */
-    recipNorm = _inv_sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
-    q[0] *= recipNorm;
-    q[1] *= recipNorm;
-    q[2] *= recipNorm;
-    q[3] *= recipNorm;
+    normalize_quaternion(q);
 }
 
-void se_mahony_ahrs_update_imu(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, float ki_2, float kp_2, float fb_i[3], float q[4]) {
-    float recipNorm;
-    float halfvx, halfvy, halfvz;
-    float halfex, halfey, halfez;
-    float qa, qb, qc;
+/*
+ * Single Mahony step with a normalized magnetometer measurement and its
+ * precomputed reference (bx, bz); the magnetic error is weighted by mag_weight
+ */
+void mahony_step_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float bx, float bz, float delta_time, float ki_2, float kp_2, float mag_weight, float fb_i[3], float q[4]) {
+    float q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+    float halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
+    float halfex = 0.0f, halfey = 0.0f, halfez = 0.0f;
 
-    /*
-*Compute feedback only if accelerometer measurement valid
-*(avoids NaN in accelerometer normalisation)
-*/
-    if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
-        /* Normalize accelerometer measurement */
-        recipNorm = _inv_sqrt(ax * ax + ay * ay + az * az);
-        ax *= recipNorm;
-        ay *= recipNorm;
-        az *= recipNorm;
+    /* Compute feedback only if accelerometer measurement is valid */
+    bool has_feedback = normalize(ax, ay, az);
+    if (has_feedback) {
+        /* Auxiliary variables to avoid repeated arithmetic */
+        q0q0 = q[0] * q[0];
+        q0q1 = q[0] * q[1];
+        q0q2 = q[0] * q[2];
+        q0q3 = q[0] * q[3];
+        q1q1 = q[1] * q[1];
+        q1q2 = q[1] * q[2];
+        q1q3 = q[1] * q[3];
+        q2q2 = q[2] * q[2];
+        q2q3 = q[2] * q[3];
+        q3q3 = q[3] * q[3];
+
+        /* Estimated direction of gravity and magnetic field */
+        halfvx = q1q3 - q0q2;
+        halfvy = q0q1 + q2q3;
+        halfvz = q0q0 - 0.5f + q3q3;
+        halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+        halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+        halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
 
         /*
-* Estimated direction of gravity and vector perpendicular to magnetic flux
-*/
+         * Error is sum of cross product between estimated direction and measured
+         * direction of field vectors, the magnetic one weighted by mag_weight
+         */
+        halfex = (ay * halfvz - az * halfvy) + mag_weight * (my * halfwz - mz * halfwy);
+        halfey = (az * halfvx - ax * halfvz) + mag_weight * (mz * halfwx - mx * halfwz);
+        halfez = (ax * halfvy - ay * halfvx) + mag_weight * (mx * halfwy - my * halfwx);
+    }
+
+    mahony_integrate(gx, gy, gz, has_feedback, halfex, halfey, halfez, delta_time, ki_2, kp_2, fb_i, q);
+}
+
+void mahony_step(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, float ki_2, float kp_2, float fb_i[3], float q[4]) {
+    float halfvx, halfvy, halfvz;
+    float halfex = 0.0f, halfey = 0.0f, halfez = 0.0f;
+
+    /* Compute feedback only if accelerometer measurement is valid */
+    bool has_feedback = normalize(ax, ay, az);
+    if (has_feedback) {
+        /* Estimated direction of gravity */
         halfvx = q[1] * q[3] - q[0] * q[2];
         halfvy = q[0] * q[1] + q[2] * q[3];
         halfvz = q[0] * q[0] - 0.5f + q[3] * q[3];
 
         /*
-* Error is sum of cross product between estimated and measured direction
-* of gravity
-*/
+         * Error is sum of cross product between estimated and measured direction
+         * of gravity
+         */
         halfex = (ay * halfvz - az * halfvy);
         halfey = (az * halfvx - ax * halfvz);
         halfez = (ax * halfvy - ay * halfvx);
+    }
 
-        /* Compute and apply integral feedback if enabled */
-        if (ki_2 > 0.0f) {
-            /* integral error scaled by Ki */
-            fb_i[0] += ki_2 * halfex * delta_time;
-            fb_i[1] += ki_2 * halfey * delta_time;
-            fb_i[2] += ki_2 * halfez * delta_time;
-            /* apply integral feedback */
-            gx += fb_i[0];
-            gy += fb_i[1];
-            gz += fb_i[2];
-        } else {
-            /* prevent integral windup */
-            fb_i[0] = 0.0f;
-            fb_i[1] = 0.0f;
-            fb_i[2] = 0.0f;
-        }
+    mahony_integrate(gx, gy, gz, has_feedback, halfex, halfey, halfez, delta_time, ki_2, kp_2, fb_i, q);
+}
 
-        /* Apply proportional feedback */
-        gx += kp_2 * halfex;
-        gy += kp_2 * halfey;
-        gz += kp_2 * halfez;
+Matrix<float, 3, 3> skew(float x, float y, float z) {
+    return Matrix<float, 3, 3>{{{0.0f, -z, y}, {z, 0.0f, -x}, {-y, x, 0.0f}}};
+}
+
+/* Inverse of a symmetric positive definite 3x3 matrix by cofactors; returns false if it is not invertible */
+bool invert_symmetric(const Matrix<float, 3, 3>& m, Matrix<float, 3, 3>& inverse) {
+    float c00 = m(1, 1) * m(2, 2) - m(1, 2) * m(1, 2);
+    float c01 = m(0, 2) * m(1, 2) - m(0, 1) * m(2, 2);
+    float c02 = m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1);
+    float c11 = m(0, 0) * m(2, 2) - m(0, 2) * m(0, 2);
+    float c12 = m(0, 1) * m(0, 2) - m(0, 0) * m(1, 2);
+    float c22 = m(0, 0) * m(1, 1) - m(0, 1) * m(0, 1);
+    float det = m(0, 0) * c00 + m(0, 1) * c01 + m(0, 2) * c02;
+    if (!(det > 0.0f))
+        return false;
+    inverse = Matrix<float, 3, 3>{{{c00, c01, c02}, {c01, c11, c12}, {c02, c12, c22}}} * (1.0f / det);
+    return true;
+}
+
+/* q = q * [1, v / 2], normalized; used both for gyro integration and for error injection */
+void rotate_quaternion(float vx, float vy, float vz, float q[4]) {
+    float qa = q[0];
+    float qb = q[1];
+    float qc = q[2];
+    q[0] += 0.5f * (-qb * vx - qc * vy - q[3] * vz);
+    q[1] += 0.5f * (qa * vx + qc * vz - q[3] * vy);
+    q[2] += 0.5f * (qa * vy - qb * vz + q[3] * vx);
+    q[3] += 0.5f * (qa * vz + qb * vy - qc * vx);
+    normalize_quaternion(q);
+}
+
+void eskf_predict(float gx, float gy, float gz, float delta_time, const EskfNoise& noise, EskfCovariance& covar, float q[4]) {
+    rotate_quaternion(gx * delta_time, gy * delta_time, gz * delta_time, q);
+
+    /*
+     * F = | A  -dt * I |, A = I - [w x] * dt
+     *     | 0   I      |
+     */
+    Matrix<float, 3, 3> A = Matrix<float, 3, 3>::identity() - skew(gx, gy, gz) * delta_time;
+    Matrix<float, 3, 3> ab = A * covar.ab - covar.bb * delta_time;
+    covar.aa = (A * covar.aa - covar.ab.transposed() * delta_time) * A.transposed() - ab * delta_time;
+    covar.ab = ab;
+    for (int i = 0; i < 3; ++i) {
+        covar.aa(i, i) += noise.gyro * delta_time;
+        covar.bb(i, i) += noise.gyro_bias * delta_time;
+    }
+    symmetrize(covar.aa);
+}
+
+/*
+ * Correct with a normalized measurement z of the body frame direction h of a
+ * known reference vector; H = [[h x], 0]
+ */
+void eskf_correct(const float z[3], const float h[3], float variance, EskfCovariance& covar, float gyro_bias[3], float q[4]) {
+    Matrix<float, 3, 3> Ht = skew(h[0], h[1], h[2]).transposed();
+
+    /* P * H' */
+    Matrix<float, 3, 3> PHa = covar.aa * Ht;
+    Matrix<float, 3, 3> PHb = covar.ab.transposed() * Ht;
+
+    Matrix<float, 3, 3> S = Ht.transposed() * PHa;
+    for (int i = 0; i < 3; ++i)
+        S(i, i) += variance;
+    Matrix<float, 3, 3> S_inverse;
+    if (!invert_symmetric(S, S_inverse))
+        return;
+
+    Matrix<float, 3, 3> Ka = PHa * S_inverse;
+    Matrix<float, 3, 3> Kb = PHb * S_inverse;
+
+    Vector<float, 3> y{{{z[0] - h[0]}, {z[1] - h[1]}, {z[2] - h[2]}}};
+    Vector<float, 3> dtheta = Ka * y;
+    Vector<float, 3> dbias = Kb * y;
+
+    /* P -= K * (P * H')' */
+    covar.aa -= Ka * PHa.transposed();
+    covar.ab -= Ka * PHb.transposed();
+    covar.bb -= Kb * PHb.transposed();
+    symmetrize(covar.aa);
+    symmetrize(covar.bb);
+
+    /* Move the error into the nominal state, which resets it to zero */
+    rotate_quaternion(dtheta(0, 0), dtheta(1, 0), dtheta(2, 0), q);
+    for (int i = 0; i < 3; ++i)
+        gyro_bias[i] += dbias(i, 0);
+}
+
+void eskf_correct_accel(float ax, float ay, float az, float variance, EskfCovariance& covar, float gyro_bias[3], float q[4]) {
+    if (!(variance > 0.0f) || !normalize(ax, ay, az))
+        return;
+    /* Estimated direction of gravity */
+    float h[3] = {2.0f * (q[1] * q[3] - q[0] * q[2]), 2.0f * (q[0] * q[1] + q[2] * q[3]), q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]};
+    float z[3] = {ax, ay, az};
+    eskf_correct(z, h, variance, covar, gyro_bias, q);
+}
+}
+
+/* IMU algorithm update */
+
+void se_madgwick_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, float beta, float mag_weight, float q[4]) {
+    /* Use IMU algorithm if magnetometer measurement is invalid */
+    if (!normalize(mx, my, mz)) {
+        madgwick_step(gx, gy, gz, ax, ay, az, delta_time, beta, q);
+        return;
     }
+    float _2bx, _2bz;
+    magnetic_reference(mx, my, mz, q, _2bx, _2bz);
+    madgwick_step_with_mag(gx, gy, gz, ax, ay, az, mx, my, mz, _2bx, _2bz, delta_time, beta, mag_weight, q);
+}
 
-    /* Integrate rate of change of quaternion */
-    /* pre-multiply common factors */
-    gx *= 0.5f * delta_time;
-    gy *= 0.5f * delta_time;
-    gz *= 0.5f * delta_time;
-    qa = q[0];
-    qb = q[1];
-    qc = q[2];
-    q[0] += -qb * gx - qc * gy - q[3] * gz;
-    q[1] += qa * gx + qc * gz - q[3] * gy;
-    q[2] += qa * gy - qb * gz + q[3] * gx;
-    q[3] += qa * gz + qb * gy - qc * gx;
+void se_madgwick_ahrs_update_imu(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, float beta, float q[4]) {
+    madgwick_step(gx, gy, gz, ax, ay, az, delta_time, beta, q);
+}
 
-    // Normalise quaternion
-    recipNorm = _inv_sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
-    q[0] *= recipNorm;
-    q[1] *= recipNorm;
-    q[2] *= recipNorm;
-    q[3] *= recipNorm;
+void se_mahony_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, float ki_2, float kp_2, float mag_weight, float fb_i[3], float q[4]) {
+    /* Use IMU algorithm if magnetometer measurement is invalid */
+    if (!normalize(mx, my, mz)) {
+        mahony_step(gx, gy, gz, ax, ay, az, delta_time, ki_2, kp_2, fb_i, q);
+        return;
+    }
+    float bx, bz;
+    magnetic_reference(mx, my, mz, q, bx, bz);
+    mahony_step_with_mag(gx, gy, gz, ax, ay, az, mx, my, mz, bx, bz, delta_time, ki_2, kp_2, mag_weight, fb_i, q);
 }
 
-#ifndef SE_NON_IEEE_STANDARD_FLOATS
+void se_mahony_ahrs_update_imu(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, float ki_2, float kp_2, float fb_i[3], float q[4]) {
+    mahony_step(gx, gy, gz, ax, ay, az, delta_time, ki_2, kp_2, fb_i, q);
+}
 
 /*
- * Fast inverse square-root
- * See: http://en.wikipedia.org/wiki/Fast_inverse_square_root
+ * Batched updates
+ *
+ * The quaternion and Mahony integrator are copied into locals for the whole
+ * burst, and the magnetometer reading (one per burst) is normalized and
+ * turned into an Earth frame reference only once.
  */
 
-float _inv_sqrt(float x) {
-    float halfx = 0.5f * (float)x;
-    float y = (float)x;
-    long i = *(long*)&y;
-    i = 0x5f3759df - (i >> 1);
-    y = *(float*)&i;
-    y = y * (1.5f - (halfx * y * y));
-    return (float)y;
+void se_madgwick_ahrs_update_imu_batch(const float (*gyro)[3], const float (*acc)[3], int count, float delta_time, float beta, float q[4]) {
+    float ql[4] = {q[0], q[1], q[2], q[3]};
+    for (int i = 0; i < count; ++i)
+        madgwick_step(gyro[i][0], gyro[i][1], gyro[i][2], acc[i][0], acc[i][1], acc[i][2], delta_time, beta, ql);
+    for (int i = 0; i < 4; ++i)
+        q[i] = ql[i];
 }
 
-#else
+void se_madgwick_ahrs_update_imu_with_mag_batch(const float (*gyro)[3], const float (*acc)[3], const float mag[3], int count, float delta_time, float beta, float mag_weight, float q[4]) {
+    float mx = mag[0], my = mag[1], mz = mag[2];
+    if (!normalize(mx, my, mz)) {
+        se_madgwick_ahrs_update_imu_batch(gyro, acc, count, delta_time, beta, q);
+        return;
+    }
+    float ql[4] = {q[0], q[1], q[2], q[3]};
+    float _2bx, _2bz;
+    magnetic_reference(mx, my, mz, ql, _2bx, _2bz);
+    for (int i = 0; i < count; ++i)
+        madgwick_step_with_mag(gyro[i][0], gyro[i][1], gyro[i][2], acc[i][0], acc[i][1], acc[i][2], mx, my, mz, _2bx, _2bz, delta_time, beta, mag_weight, ql);
+    for (int i = 0; i < 4; ++i)
+        q[i] = ql[i];
+}
 
-float _inv_sqrt(float x) {
-    return 1.0f / sqrt(x);
+void se_mahony_ahrs_update_imu_batch(const float (*gyro)[3], const float (*acc)[3], int count, float delta_time, float ki_2, float kp_2, float fb_i[3], float q[4]) {
+    float ql[4] = {q[0], q[1], q[2], q[3]};
+    float fb[3] = {fb_i[0], fb_i[1], fb_i[2]};
+    for (int i = 0; i < count; ++i)
+        mahony_step(gyro[i][0], gyro[i][1], gyro[i][2], acc[i][0], acc[i][1], acc[i][2], delta_time, ki_2, kp_2, fb, ql);
+    for (int i = 0; i < 4; ++i)
+        q[i] = ql[i];
+    for (int i = 0; i < 3; ++i)
+        fb_i[i] = fb[i];
 }
 
-#endif
+void se_mahony_ahrs_update_imu_with_mag_batch(const float (*gyro)[3], const float (*acc)[3], const float mag[3], int count, float delta_time, float ki_2, float kp_2, float mag_weight, float fb_i[3], float q[4]) {
+    float mx = mag[0], my = mag[1], mz = mag[2];
+    if (!normalize(mx, my, mz)) {
+        se_mahony_ahrs_update_imu_batch(gyro, acc, count, delta_time, ki_2, kp_2, fb_i, q);
+        return;
+    }
+    float ql[4] = {q[0], q[1], q[2], q[3]};
+    float fb[3] = {fb_i[0], fb_i[1], fb_i[2]};
+    float bx, bz;
+    magnetic_reference(mx, my, mz, ql, bx, bz);
+    for (int i = 0; i < count; ++i)
+        mahony_step_with_mag(gyro[i][0], gyro[i][1], gyro[i][2], acc[i][0], acc[i][1], acc[i][2], mx, my, mz, bx, bz, delta_time, ki_2, kp_2, mag_weight, fb, ql);
+    for (int i = 0; i < 4; ++i)
+        q[i] = ql[i];
+    for (int i = 0; i < 3; ++i)
+        fb_i[i] = fb[i];
+}
+
+void se_eskf_init(float attitude_variance, float bias_variance, EskfCovariance* covar) {
+    covar->aa = Matrix<float, 3, 3>::identity() * attitude_variance;
+    covar->ab = Matrix<float, 3, 3>::zeros();
+    covar->bb = Matrix<float, 3, 3>::identity() * bias_variance;
+}
+
+void se_eskf_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, const EskfNoise& noise, EskfCovariance* covar, float gyro_bias[3], float q[4]) {
+    eskf_predict(gx, gy, gz, delta_time, noise, *covar, q);
+    eskf_correct_accel(ax, ay, az, noise.accel, *covar, gyro_bias, q);
+
+    if (!(noise.mag > 0.0f) || !normalize(mx, my, mz))
+        return;
+    float bx, bz;
+    magnetic_reference(mx, my, mz, q, bx, bz);
+    /* Estimated direction of magnetic field */
+    float h[3] = {
+        bx * (1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3])) + 2.0f * bz * (q[1] * q[3] - q[0] * q[2]),
+        2.0f * bx * (q[1] * q[2] - q[0] * q[3]) + 2.0f * bz * (q[0] * q[1] + q[2] * q[3]),
+        2.0f * bx * (q[0] * q[2] + q[1] * q[3]) + bz * (1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2])),
+    };
+    float z[3] = {mx, my, mz};
+    eskf_correct(z, h, noise.mag, *covar, gyro_bias, q);
+}
+
+void se_eskf_ahrs_update_imu(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, const EskfNoise& noise, EskfCovariance* covar, float gyro_bias[3], float q[4]) {
+    eskf_predict(gx, gy, gz, delta_time, noise, *covar, q);
+    eskf_correct_accel(ax, ay, az, noise.accel, *covar, gyro_bias, q);
+}
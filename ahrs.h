@@ -1,12 +1,62 @@
 #ifndef SE_AHRS_H_
 #define SE_AHRS_H_
 
-void se_madgwick_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, float beta, float q[4]);
+#include "matrix.h"
+
+/*
+ * The magnetometer correction is scaled by mag_weight relative to the
+ * accelerometer one. Both gains are rates, so a measurement reused on several
+ * consecutive steps corrects the heading equally fast at any step size.
+ */
+
+void se_madgwick_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, float beta, float mag_weight, float q[4]);
 
 void se_madgwick_ahrs_update_imu(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, float beta, float q[4]);
 
-void se_mahony_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, float ki_2, float kp_2, float fb_i[3], float q[4]);
+void se_mahony_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, float ki_2, float kp_2, float mag_weight, float fb_i[3], float q[4]);
 
 void se_mahony_ahrs_update_imu(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, float ki_2, float kp_2, float fb_i[3], float q[4]);
 
+/*
+ * Batched variants integrate `count` consecutive samples with the same time
+ * step, e.g. a FIFO burst. The magnetometer reading is shared by the burst.
+ */
+
+void se_madgwick_ahrs_update_imu_with_mag_batch(const float (*gyro)[3], const float (*acc)[3], const float mag[3], int count, float delta_time, float beta, float mag_weight, float q[4]);
+
+void se_madgwick_ahrs_update_imu_batch(const float (*gyro)[3], const float (*acc)[3], int count, float delta_time, float beta, float q[4]);
+
+void se_mahony_ahrs_update_imu_with_mag_batch(const float (*gyro)[3], const float (*acc)[3], const float mag[3], int count, float delta_time, float ki_2, float kp_2, float mag_weight, float fb_i[3], float q[4]);
+
+void se_mahony_ahrs_update_imu_batch(const float (*gyro)[3], const float (*acc)[3], int count, float delta_time, float ki_2, float kp_2, float fb_i[3], float q[4]);
+
+/*
+ * Multiplicative error-state Kalman filter
+ *
+ * The error state is [attitude error in body frame, gyro bias error]. Its 6x6
+ * covariance is kept as three 3x3 blocks, the fourth one being the transpose
+ * of ab. Gyro rates passed in must already have gyro_bias subtracted; the
+ * filter refines gyro_bias in place.
+ */
+
+struct EskfCovariance {
+    Matrix<float, 3, 3> aa;
+    Matrix<float, 3, 3> ab;
+    Matrix<float, 3, 3> bb;
+};
+
+/* Variances: gyro and gyro_bias are per second, accel and mag are of the normalized vectors; non-positive skips that correction */
+struct EskfNoise {
+    float gyro;
+    float gyro_bias;
+    float accel;
+    float mag;
+};
+
+void se_eskf_init(float attitude_variance, float bias_variance, EskfCovariance* covar);
+
+void se_eskf_ahrs_update_imu_with_mag(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float delta_time, const EskfNoise& noise, EskfCovariance* covar, float gyro_bias[3], float q[4]);
+
+void se_eskf_ahrs_update_imu(float gx, float gy, float gz, float ax, float ay, float az, float delta_time, const EskfNoise& noise, EskfCovariance* covar, float gyro_bias[3], float q[4]);
+
 #endif /* end of include guard: SE_AHRS_H_ */
@@ -6,17 +6,115 @@
 
 #include "airframe.h"
 #include <Arduino.h>
+#include "allocation.h"
+#include "debug.h"
 #include "state.h"
 
-Airframe::Airframe(State* state) : state(state) {
+bool Airframe::MotorGeometry::verify() const {
+    bool ok{true};
+    for (size_t i = 0; i < 8; ++i) {
+        if (spin[i] < -1 || spin[i] > 1) {
+            DebugPrint("Motor spin must be 1 (CW), -1 (CCW) or 0 (no motor)");
+            ok = false;
+        }
+        if (spin[i] != 0 && !(thrust[i] > 0.0f && torque[i] > 0.0f)) {
+            DebugPrint("Motor thrust and torque coefficients must be positive");
+            ok = false;
+        }
+    }
+    if (enabled > 1) {
+        DebugPrint("Motor geometry must be enabled with 1 or disabled with 0");
+        ok = false;
+    }
+    float matrix[8][4];
+    const float no_offset[2]{0.0f, 0.0f};
+    if (ok && enabled && !allocateMix(*this, no_offset, matrix)) {
+        DebugPrint("Motor geometry cannot produce independent thrust, pitch, roll and yaw");
+        ok = false;
+    }
+    return ok;
 }
 
-uint16_t Airframe::mix(int32_t mFz, int32_t mTx, int32_t mTy, int32_t mTz) {
-    int32_t mmax = max(max(mFz, mTx), max(mTy, mTz));
-    return constrain((mFz * state->Fz + mTx * state->Tx + mTy * state->Ty + mTz * state->Tz) / mmax, 0, 4095);
+Airframe::Airframe(State* state) : motor_geometry(), state(state), pcb_offset{0.0f, 0.0f} {
+    setMixTable(MixTable());
+}
+
+void Airframe::setMixTable(const MixTable& table) {
+    mix_table = table;
+    buildMixMatrix();
+}
+
+void Airframe::setMotorGeometry(const MotorGeometry& geometry, const float (&pcb_translation)[3]) {
+    motor_geometry = geometry;
+    pcb_offset[0] = pcb_translation[0];
+    pcb_offset[1] = pcb_translation[1];
+    buildMixMatrix();
+}
+
+void Airframe::buildMixMatrix() {
+    if (motor_geometry.enabled) {
+        if (allocateMix(motor_geometry, pcb_offset, mix_matrix)) {
+            for (size_t i = 0; i < 8; ++i)
+                in_mix[i] = (motor_geometry.spin[i] != 0);
+            return;
+        }
+        DebugPrint("Motor geometry is singular, falling back to the mix table");
+    }
+
+    // each row of the table divided by its largest entry
+    for (size_t i = 0; i < 8; ++i) {
+        int8_t mmax = max(max(mix_table.fz[i], mix_table.tx[i]), max(mix_table.ty[i], mix_table.tz[i]));
+        in_mix[i] = (mmax != 0);
+        float scale = in_mix[i] ? 1.0f / mmax : 0.0f;
+        mix_matrix[i][0] = mix_table.fz[i] * scale;
+        mix_matrix[i][1] = mix_table.tx[i] * scale;
+        mix_matrix[i][2] = mix_table.ty[i] * scale;
+        mix_matrix[i][3] = mix_table.tz[i] * scale;
+    }
 }
 
 void Airframe::updateMotorsMix() {
+    float thrust[8];
+    float torque[8];
+    float torque_min{INFINITY};
+    float torque_max{-INFINITY};
+    for (size_t i = 0; i < 8; ++i) {
+        thrust[i] = mix_matrix[i][0] * state->Fz;
+        torque[i] = mix_matrix[i][1] * state->Tx + mix_matrix[i][2] * state->Ty + mix_matrix[i][3] * state->Tz;
+        if (in_mix[i]) {
+            torque_min = min(torque_min, torque[i]);
+            torque_max = max(torque_max, torque[i]);
+        }
+    }
+
+    uint8_t saturation{0};
+    float torque_scale{1.0f};
+    if (torque_max - torque_min > 4095.0f) {
+        torque_scale = 4095.0f / (torque_max - torque_min);
+        saturation |= SATURATION_TORQUE;
+    }
+
+    float out[8];
+    float out_min{4095.0f};
+    float out_max{0.0f};
+    for (size_t i = 0; i < 8; ++i) {
+        out[i] = thrust[i] + torque_scale * torque[i];
+        if (in_mix[i]) {
+            out_min = min(out_min, out[i]);
+            out_max = max(out_max, out[i]);
+        }
+    }
+
+    float shift{0.0f};
+    if (out_max > 4095.0f) {
+        shift = 4095.0f - out_max;
+        saturation |= SATURATION_THRUST_CUT;
+    } else if (out_min < 0.0f) {
+        shift = -out_min;
+        saturation |= SATURATION_THRUST_BOOST;
+    }
+
     for (size_t i = 0; i < 8; ++i)
-        state->MotorOut[i] = mix(mix_table.fz[i], mix_table.tx[i], mix_table.ty[i], mix_table.tz[i]);
+        state->MotorOut[i] = in_mix[i] ? constrain(out[i] + shift, 0.0f, 4095.0f) : 0;
+    state->mixSaturation = saturation;
 }
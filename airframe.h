@@ -6,6 +6,12 @@
     <airframe.h/cpp>
 
     Airframe translates the four control vectors (thrust force, pitch torque, roll torque, yaw torque) into Motor Levels
+
+    The mix comes either from the hand written mix table, or from the motor geometry, as the pseudo-inverse
+    B' (B B')^-1 of the matrix B that maps motor levels to thrust and torques. Either way it is turned into a float
+    matrix when the configuration is set, with each thrust/torque column scaled to a largest entry of 1. Outputs that do not fit into the motor range are
+    desaturated with torque priority: the torques are scaled down only if their spread alone exceeds the range, and
+    the thrust of all motors in the mix is shifted until every motor is back within the range.
 */
 
 #ifndef airframe_h
@@ -17,6 +23,13 @@ class State;
 
 class Airframe {
    public:
+    // reported in State::mixSaturation
+    enum Saturation : uint8_t {
+        SATURATION_TORQUE = 1 << 0,        // torques were scaled down to fit
+        SATURATION_THRUST_CUT = 1 << 1,    // thrust was lowered to fit the torques
+        SATURATION_THRUST_BOOST = 1 << 2,  // thrust was raised to fit the torques
+    };
+
     Airframe(State* state);
     void updateMotorsMix();
 
@@ -32,9 +45,29 @@ class Airframe {
 
     static_assert(sizeof(MixTable) == 4 * 8, "Data is not packed");
 
+    struct __attribute__((packed)) MotorGeometry {
+        bool verify() const;
+        float position[8][2];  // x (right), y (forward) of each motor in mm, relative to the PCB
+        float thrust[8];       // relative thrust of each motor at the same level
+        float torque[8];       // relative yaw reaction torque of each motor at the same level
+        int8_t spin[8];        // 1 for CW, -1 for CCW, 0 for no motor on the channel; CW motors get tz = -1 in the mix
+        uint8_t enabled;       // 1 to build the mix from the geometry, 0 to use the mix table
+    } motor_geometry;
+
+    static_assert(sizeof(MotorGeometry) == 8 * 2 * 4 + 8 * 4 * 2 + 8 + 1, "Data is not packed");
+
+    void setMixTable(const MixTable& table);
+    // pcb_translation is the position of the PCB relative to the center of mass, in mm
+    void setMotorGeometry(const MotorGeometry& geometry, const float (&pcb_translation)[3]);
+
    private:
-    uint16_t mix(int32_t mFz, int32_t mTx, int32_t mTy, int32_t mTz);
+    void buildMixMatrix();
+
     State* state;
+    float pcb_offset[2];
+    // rows of motors that are not in the mix are zero
+    float mix_matrix[8][4];
+    bool in_mix[8];
 };
 
 #endif
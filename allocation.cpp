@@ -0,0 +1,60 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+*/
+
+#include "allocation.h"
+#include <cmath>
+#include <cstddef>
+#include "lapack.h"
+
+bool allocateMix(const Airframe::MotorGeometry& geometry, const float (&offset)[2], float (&matrix)[8][4]) {
+    // B', the thrust and torques produced by each motor
+    float effect[8][4];
+    for (size_t i = 0; i < 8; ++i) {
+        const float thrust = (geometry.spin[i] == 0) ? 0.0f : geometry.thrust[i];
+        effect[i][0] = thrust;
+        effect[i][1] = thrust * (geometry.position[i][1] + offset[1]);   // front motors pitch the nose up
+        effect[i][2] = -thrust * (geometry.position[i][0] + offset[0]);  // right motors roll the right side up
+        effect[i][3] = -geometry.spin[i] * geometry.torque[i];  // Tz<0 increases CW motors
+    }
+
+    // B B' is symmetric, so its storage order does not matter to the column major lapack routines
+    float bbt[4][4];
+    for (size_t r = 0; r < 4; ++r) {
+        for (size_t c = 0; c < 4; ++c) {
+            bbt[r][c] = 0.0f;
+            for (size_t i = 0; i < 8; ++i)
+                bbt[r][c] += effect[i][r] * effect[i][c];
+        }
+    }
+    const int n = 4;
+    const int workspace_length = n * n;
+    int pivots[n];
+    float workspace[workspace_length];
+    int info;
+    Fgetrf_(&n, &n, &bbt[0][0], &n, pivots, &info);
+    if (info != 0)
+        return false;
+    Fgetri_(&n, &bbt[0][0], &n, pivots, workspace, &workspace_length, &info);
+    if (info != 0)
+        return false;
+
+    float column_max[4]{0.0f, 0.0f, 0.0f, 0.0f};
+    for (size_t i = 0; i < 8; ++i) {
+        for (size_t c = 0; c < 4; ++c) {
+            matrix[i][c] = 0.0f;
+            for (size_t k = 0; k < 4; ++k)
+                matrix[i][c] += effect[i][k] * bbt[k][c];
+            column_max[c] = fmaxf(column_max[c], fabsf(matrix[i][c]));
+        }
+    }
+    for (size_t c = 0; c < 4; ++c) {
+        if (column_max[c] == 0.0f)
+            return false;
+        for (size_t i = 0; i < 8; ++i)
+            matrix[i][c] /= column_max[c];
+    }
+    return true;
+}
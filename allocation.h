@@ -0,0 +1,24 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+    *
+
+    <allocation.h/cpp>
+
+    Control allocation from motor geometry.
+
+    Free of hardware dependencies, so that it can be checked on the host (see bench/mix_geometry_check.cpp).
+
+*/
+
+#ifndef ALLOCATION_H
+#define ALLOCATION_H
+
+#include "airframe.h"
+
+// pseudo-inverse allocation of the geometry, with each column scaled to a largest entry of 1; false if singular
+// offset is added to every motor position, so it is the position of the motor coordinate origin relative to the center of mass
+bool allocateMix(const Airframe::MotorGeometry& geometry, const float (&offset)[2], float (&matrix)[8][4]);
+
+#endif
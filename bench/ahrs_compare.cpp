@@ -0,0 +1,207 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <ahrs_compare.cpp>
+
+    Host comparison of the Madgwick, Mahony and error-state Kalman attitude filters.
+
+    Each filter is run through Localization::ProcessMeasurementIMU, as the firmware does, on the same synthetic flight
+    with a known attitude. Madgwick and the EKF use the default State::Parameters; the default state_estimation gains
+    are a Madgwick beta, so Mahony gets ki_2 = 0.02 and kp_2 = 2 instead, in the order Localization passes them.
+    - roll and pitch swing by up to 30 and 23 degrees and the heading turns continuously, 5 minutes in all;
+    - gyro readings carry a constant bias of (0.02, -0.01, 0.015) rad/s and white noise of 0.01 rad/s;
+    - accelerometer readings carry white noise of 0.02 g and no linear acceleration;
+    - magnetometer readings arrive at 10 Hz, as from ProcessTask<10>, with 2% noise.
+    The filters start from the firmware's initial attitude while the true heading is 20 degrees away from it.
+
+    It reports RMS and worst tilt and heading errors after the first 30 s, the time after which the heading error stays
+    within 10 degrees, and the time per IMU sample, which covers the whole ProcessMeasurementIMU call including the
+    altitude filter and the clock reads around it. Running it at several IMU rates shows whether the magnetometer
+    weighting depends on the rate.
+
+    Build and run from the repository root, optionally passing the IMU rate in Hz (default 1000):
+
+        g++ -std=gnu++11 -O2 -I. bench/ahrs_compare.cpp localization.cpp ahrs.cpp kalman.cpp -o ahrs_compare && ./ahrs_compare
+
+    Host timings only rank the filters; cycle counts for the Cortex-M4F have to be taken on the target.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "localization.h"
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+const double RAD_TO_DEG = 180.0 / PI;
+const double DURATION = 300.0;  // s
+const double SETTLING = 30.0;   // s
+const double MAG_RATE = 10.0;   // Hz
+const double HEADING_SETTLED = 10.0 / RAD_TO_DEG;
+
+// keep in sync with state.cpp and the State::Parameters defaults in config.cpp
+const float EXPECTED_TIME_STEP = 0.002f;
+const float BARO_VARIANCE = 1e-3f;
+const float STATE_ESTIMATION[2]{1.0f, 0.01f};
+const float MAHONY_STATE_ESTIMATION[2]{0.02f, 2.0f};
+const double INITIAL_Q[4]{0.0, 1.0, 0.0, 0.0};
+
+const double GYRO_BIAS[3]{0.02, -0.01, 0.015};  // rad/s
+const double GYRO_NOISE = 0.01;                  // rad/s
+const double ACC_NOISE = 0.02;                   // g
+const double MAG_NOISE = 0.02;                   // of the field strength
+const double MAG_EARTH[3]{0.45, 0.0, -0.89};     // north and up, normalized
+
+struct Quaternion {
+    double w, x, y, z;
+};
+
+Quaternion multiply(const Quaternion& a, const Quaternion& b) {
+    return {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z, a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y, a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+}
+
+Quaternion conjugate(const Quaternion& q) {
+    return {q.w, -q.x, -q.y, -q.z};
+}
+
+// body to earth rotation matrix
+void rotation(const Quaternion& q, double r[3][3]) {
+    r[0][0] = 1 - 2 * (q.y * q.y + q.z * q.z);
+    r[0][1] = 2 * (q.x * q.y - q.w * q.z);
+    r[0][2] = 2 * (q.x * q.z + q.w * q.y);
+    r[1][0] = 2 * (q.x * q.y + q.w * q.z);
+    r[1][1] = 1 - 2 * (q.x * q.x + q.z * q.z);
+    r[1][2] = 2 * (q.y * q.z - q.w * q.x);
+    r[2][0] = 2 * (q.x * q.z - q.w * q.y);
+    r[2][1] = 2 * (q.y * q.z + q.w * q.x);
+    r[2][2] = 1 - 2 * (q.x * q.x + q.y * q.y);
+}
+
+// an earth frame vector as seen in the body frame
+void toBody(const Quaternion& q, const double earth[3], double body[3]) {
+    double r[3][3];
+    rotation(q, r);
+    for (int i = 0; i < 3; ++i)
+        body[i] = r[0][i] * earth[0] + r[1][i] * earth[1] + r[2][i] * earth[2];
+}
+
+// the true attitude: a roll/pitch/yaw motion applied on top of the firmware's initial attitude
+Quaternion trueAttitude(double t) {
+    double roll = 0.52 * std::sin(0.7 * t);
+    double pitch = 0.4 * std::sin(0.5 * t + 1.0);
+    double yaw = 0.35 + 0.3 * t + 0.5 * std::sin(0.2 * t);
+    Quaternion qz{std::cos(yaw / 2), 0, 0, std::sin(yaw / 2)};
+    Quaternion qy{std::cos(pitch / 2), 0, std::sin(pitch / 2), 0};
+    Quaternion qx{std::cos(roll / 2), std::sin(roll / 2), 0, 0};
+    Quaternion mount{INITIAL_Q[0], INITIAL_Q[1], INITIAL_Q[2], INITIAL_Q[3]};
+    return multiply(multiply(multiply(qz, qy), qx), mount);
+}
+
+// body rates from the derivative of the true attitude, w = 2 q* dq/dt
+void trueRates(double t, double rate[3]) {
+    const double h = 1e-6;
+    Quaternion a = trueAttitude(t - h), b = trueAttitude(t + h), q = trueAttitude(t);
+    Quaternion dq{(b.w - a.w) / (2 * h), (b.x - a.x) / (2 * h), (b.y - a.y) / (2 * h), (b.z - a.z) / (2 * h)};
+    Quaternion w = multiply(conjugate(q), dq);
+    rate[0] = 2 * w.x;
+    rate[1] = 2 * w.y;
+    rate[2] = 2 * w.z;
+}
+
+struct Errors {
+    double tilt_sq{0.0}, tilt_max{0.0};
+    double heading_sq{0.0}, heading_max{0.0};
+    double heading_settling{0.0};
+    int count{0};
+    double ns_per_sample{0.0};
+};
+
+Errors run(FilterType type, double imu_rate) {
+    Localization localization{float(INITIAL_Q[0]), float(INITIAL_Q[1]), float(INITIAL_Q[2]), float(INITIAL_Q[3]), EXPECTED_TIME_STEP, type,
+                              type == FilterType::Mahony ? MAHONY_STATE_ESTIMATION : STATE_ESTIMATION, BARO_VARIANCE};
+    std::mt19937 rng(4);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    const double up[3]{0.0, 0.0, 1.0};
+    const int steps = int(DURATION * imu_rate);
+    const int mag_divider = int(imu_rate / MAG_RATE);
+
+    Errors errors;
+    std::chrono::steady_clock::duration busy{0};
+    for (int i = 1; i <= steps; ++i) {
+        double t = i / imu_rate;
+        Quaternion q = trueAttitude(t);
+        double rate[3], acc[3];
+        trueRates(t, rate);
+        toBody(q, up, acc);
+        float gyro_reading[3], acc_reading[3];
+        for (int a = 0; a < 3; ++a) {
+            gyro_reading[a] = float(rate[a] + GYRO_BIAS[a] + GYRO_NOISE * noise(rng));
+            acc_reading[a] = float(acc[a] + ACC_NOISE * noise(rng));
+        }
+        if (i % mag_divider == 0) {
+            double mag[3];
+            toBody(q, MAG_EARTH, mag);
+            float mag_reading[3];
+            for (int a = 0; a < 3; ++a)
+                mag_reading[a] = float(500.0 * (mag[a] + MAG_NOISE * noise(rng)));  // milligauss
+            localization.ProcessMeasurementMagnetometer(mag_reading);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        localization.ProcessMeasurementIMU(unsigned(std::lround(t * 1e6)), gyro_reading, acc_reading);
+        busy += std::chrono::steady_clock::now() - start;
+
+        const float* qf = localization.getAhrsQuaternion();
+        Quaternion estimate{qf[0], qf[1], qf[2], qf[3]};
+        double norm = std::sqrt(estimate.w * estimate.w + estimate.x * estimate.x + estimate.y * estimate.y + estimate.z * estimate.z);
+        estimate = {estimate.w / norm, estimate.x / norm, estimate.y / norm, estimate.z / norm};
+
+        // tilt: angle between the true and estimated vertical, in the body frame
+        double v_true[3], v_estimate[3];
+        toBody(q, up, v_true);
+        toBody(estimate, up, v_estimate);
+        double cos_tilt = v_true[0] * v_estimate[0] + v_true[1] * v_estimate[1] + v_true[2] * v_estimate[2];
+        double tilt = std::acos(std::fmax(-1.0, std::fmin(1.0, cos_tilt)));
+        // heading: rotation of the earth frame error about the vertical
+        double e[3][3];
+        rotation(multiply(estimate, conjugate(q)), e);
+        double heading = std::fabs(std::atan2(e[1][0] - e[0][1], e[0][0] + e[1][1]));
+
+        if (heading > HEADING_SETTLED)
+            errors.heading_settling = t;
+        if (t < SETTLING)
+            continue;
+        errors.tilt_sq += tilt * tilt;
+        errors.tilt_max = std::fmax(errors.tilt_max, tilt);
+        errors.heading_sq += heading * heading;
+        errors.heading_max = std::fmax(errors.heading_max, heading);
+        ++errors.count;
+    }
+    errors.ns_per_sample = std::chrono::duration<double, std::nano>(busy).count() / steps;
+    return errors;
+}
+
+void report(const char* name, FilterType type, double imu_rate) {
+    Errors e = run(type, imu_rate);
+    printf("%-9s tilt RMS %6.3f deg, max %6.3f deg | heading RMS %6.3f deg, max %6.3f deg, within 10 deg after %5.2f s | %6.1f ns per IMU sample\n", name,
+           std::sqrt(e.tilt_sq / e.count) * RAD_TO_DEG, e.tilt_max * RAD_TO_DEG, std::sqrt(e.heading_sq / e.count) * RAD_TO_DEG, e.heading_max * RAD_TO_DEG, e.heading_settling,
+           e.ns_per_sample);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    double imu_rate = argc > 1 ? std::atof(argv[1]) : 1000.0;
+    printf("IMU at %.0f Hz, magnetometer at %.0f Hz, %.0f s, errors after %.0f s\n", imu_rate, MAG_RATE, DURATION, SETTLING);
+    report("madgwick", FilterType::Madgwick, imu_rate);
+    report("mahony", FilterType::Mahony, imu_rate);
+    report("ekf", FilterType::Ekf, imu_rate);
+    return 0;
+}
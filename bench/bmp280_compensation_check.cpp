@@ -0,0 +1,162 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <bmp280_compensation_check.cpp>
+
+    Host check of the BMP280 pressure compensation in BMP280.cpp against the datasheet's 64 bit reference.
+
+    The firmware routines are copied here, since BMP280.cpp needs the Arduino and i2c headers, and must be kept in sync
+    with it. Both run on the datasheet's example calibration, for raw temperatures covering -40 to 85 degC and raw
+    pressures covering 300 to 1100 hPa, the sensor's operating range. It reports the largest difference in Pa and the
+    time per call of each routine, and exits with 1 if the difference exceeds MAX_ERROR.
+
+    Build and run from the repository root:
+
+        g++ -std=gnu++11 -O2 -I. bench/bmp280_compensation_check.cpp -o bmp280check && ./bmp280check
+
+    The host divides 64 bit integers natively, so its timings do not rank the variants as the Cortex-M4F would, which
+    has no 64 bit divide; cycle counts have to be taken on the target.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+namespace {
+
+const double MAX_ERROR = 1.0;          // Pa
+const double MIN_TEMPERATURE = -40.0;  // degC
+const double MAX_TEMPERATURE = 85.0;
+const double MIN_PRESSURE = 30000.0;   // Pa
+const double MAX_PRESSURE = 110000.0;
+const int32_t RAW_T_STRIDE = 64;
+const int32_t RAW_P_STRIDE = 16;
+
+struct Calibration {
+    uint16_t dig_T1;
+    int16_t dig_T2;
+    int16_t dig_T3;
+    uint16_t dig_P1;
+    int16_t dig_P2;
+    int16_t dig_P3;
+    int16_t dig_P4;
+    int16_t dig_P5;
+    int16_t dig_P6;
+    int16_t dig_P7;
+    int16_t dig_P8;
+    int16_t dig_P9;
+};
+
+// datasheet section 3.12, example calibration
+const Calibration CALIBRATION{27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000};
+
+// keep in sync with BMP280::compensate_T_int32, returns t_fine
+int32_t compensateT(const Calibration& c, int32_t rawT) {
+    int32_t var1, var2;
+    var1 = ((((rawT >> 3) - ((int32_t)c.dig_T1 << 1))) * ((int32_t)c.dig_T2)) >> 11;
+    var2 = (((((rawT >> 4) - ((int32_t)c.dig_T1)) * ((rawT >> 4) - ((int32_t)c.dig_T1))) >> 12) * ((int32_t)c.dig_T3)) >> 14;
+    return var1 + var2;
+}
+
+// keep in sync with BMP280::compensate_P_int32
+uint32_t compensatePInt32(const Calibration& c, int32_t t_fine, int32_t rawP) {
+    int32_t var1, var2;
+    uint32_t p;
+    var1 = (((int32_t)t_fine) >> 1) - (int32_t)64000;
+    var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)c.dig_P6);
+    var2 = var2 + ((var1 * ((int32_t)c.dig_P5)) << 1);
+    var2 = (var2 >> 2) + (((int32_t)c.dig_P4) << 16);
+    var1 = ((c.dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + ((((int32_t)c.dig_P2) * var1) >> 1);
+    float divisor = (float)c.dig_P1 * (1.0f + (float)var1 * (1.0f / 8589934592.0f));  // var1 / 2^33
+    if (!(divisor > 0.0f)) {
+        return 0;  // avoid exception caused by division by zero
+    }
+    float pressure = ((float)(((int32_t)1048576) - rawP) - (float)var2 * (1.0f / 4096.0f)) * 6250.0f / divisor;
+    p = (uint32_t)pressure;
+    var1 = (((int32_t)c.dig_P9) * ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
+    var2 = (((int32_t)(p >> 2)) * ((int32_t)c.dig_P8)) >> 13;
+    return (uint32_t)((int32_t)(pressure * 256.0f) + (var1 + var2 + c.dig_P7) * 16);
+}
+
+// datasheet section 8.2, pressure in Pa as Q24.8
+uint32_t compensatePInt64(const Calibration& c, int32_t t_fine, int32_t rawP) {
+    int64_t var1, var2, p;
+    var1 = ((int64_t)t_fine) - 128000;
+    var2 = var1 * var1 * (int64_t)c.dig_P6;
+    var2 = var2 + ((var1 * (int64_t)c.dig_P5) << 17);
+    var2 = var2 + (((int64_t)c.dig_P4) << 35);
+    var1 = ((var1 * var1 * (int64_t)c.dig_P3) >> 8) + ((var1 * (int64_t)c.dig_P2) << 12);
+    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)c.dig_P1) >> 33;
+    if (var1 == 0) {
+        return 0;  // avoid exception caused by division by zero
+    }
+    p = 1048576 - rawP;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t)c.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t)c.dig_P8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t)c.dig_P7) << 4);
+    return (uint32_t)p;
+}
+
+double temperature(int32_t t_fine) {
+    return ((t_fine * 5 + 128) >> 8) / 100.0;
+}
+
+double pascal(uint32_t q24_8) {
+    return q24_8 / 256.0;
+}
+
+volatile uint32_t sink;
+
+}  // namespace
+
+int main() {
+    // the raw readings fall with pressure and rise with temperature
+    int32_t rawT_min = 0;
+    while (temperature(compensateT(CALIBRATION, rawT_min)) < MIN_TEMPERATURE)
+        rawT_min += RAW_T_STRIDE;
+
+    double worst = 0.0;
+    int32_t worst_rawT = 0, worst_rawP = 0;
+    long long samples = 0;
+    int32_t rawT = rawT_min;
+    for (; rawT < (1 << 20) && temperature(compensateT(CALIBRATION, rawT)) <= MAX_TEMPERATURE; rawT += RAW_T_STRIDE) {
+        int32_t t_fine = compensateT(CALIBRATION, rawT);
+        for (int32_t rawP = 0; rawP < (1 << 20); rawP += RAW_P_STRIDE) {
+            double reference = pascal(compensatePInt64(CALIBRATION, t_fine, rawP));
+            if (reference > MAX_PRESSURE)
+                continue;
+            if (reference < MIN_PRESSURE)
+                break;
+            double error = std::fabs(pascal(compensatePInt32(CALIBRATION, t_fine, rawP)) - reference);
+            if (error > worst) {
+                worst = error;
+                worst_rawT = rawT;
+                worst_rawP = rawP;
+            }
+            ++samples;
+        }
+    }
+    printf("%lld samples, raw temperature %d..%d, %.0f..%.0f hPa\n", samples, rawT_min, rawT - RAW_T_STRIDE, MIN_PRESSURE / 100, MAX_PRESSURE / 100);
+    printf("max error %.4f Pa at rawT %d, rawP %d\n", worst, worst_rawT, worst_rawP);
+
+    // timing at a typical reading, 25 degC and 1000 hPa
+    const int calls = 10000000;
+    const int32_t t_fine = compensateT(CALIBRATION, 519888);
+    uint32_t acc = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i)
+        acc += compensatePInt32(CALIBRATION, t_fine, 415148 + (i & 255));
+    auto middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i)
+        acc += compensatePInt64(CALIBRATION, t_fine, 415148 + (i & 255));
+    auto stop = std::chrono::steady_clock::now();
+    sink = acc;
+    printf("int32 %.2f ns, int64 %.2f ns per call\n", std::chrono::duration<double, std::nano>(middle - start).count() / calls,
+           std::chrono::duration<double, std::nano>(stop - middle).count() / calls);
+
+    return worst > MAX_ERROR ? 1 : 0;
+}
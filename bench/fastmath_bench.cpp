@@ -0,0 +1,279 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <fastmath_bench.cpp>
+
+    Host benchmark of the fastmath.h approximations against libm.
+
+    For every function it reports the maximum absolute error against the double precision libm result over a dense sweep,
+    and the time per call of the fastmath version, the float libm version and the double libm version.
+
+    The angle functions are then swept over their full domains:
+    - fast_atan_unit, the polynomial behind both, at every float in [0, 1];
+    - fast_asin at every float in [0, 1], which covers [-1, 1] since it is exactly odd;
+    - fast_atan2 in all four quadrants, on both axes and with magnitudes from 1e-30 to 1e30; (0, 0) has no angle
+      and is left out, and errors are wrapped to [-pi, pi] so that the -0 side of the branch cut counts as pi;
+    - the Euler angle conversion of State::updateStateIMU, for random attitudes and for ones close to gimbal lock.
+    Each reports the maximum angle error in radians and degrees. The sweeps take about two minutes.
+
+    Build and run from the repository root:
+
+        g++ -std=gnu++11 -O2 -I. bench/fastmath_bench.cpp -o fastmath_bench && ./fastmath_bench
+
+    Add -DFASTMATH_INV_SQRT_NEWTON or -DFASTMATH_INV_SQRT_SSE to measure the other inv_sqrt paths.
+    Host timings only rank the variants; cycle counts for the Cortex-M4F have to be taken on the target.
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "fastmath.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+namespace {
+
+const int SWEEP = 1000000;
+const int REPEATS = 20;
+
+volatile float sink;
+
+struct Timing {
+    double ns;
+    double ticks;
+};
+
+template <typename F>
+Timing timeCalls(const std::vector<float>& a, const std::vector<float>& b, F f) {
+    float acc = 0.0f;
+    auto start = std::chrono::steady_clock::now();
+#ifdef BENCH_HAS_TSC
+    unsigned long long tsc = __rdtsc();
+#endif
+    for (int r = 0; r < REPEATS; ++r)
+        for (size_t i = 0; i < a.size(); ++i)
+            acc += f(a[i], b[i]);
+#ifdef BENCH_HAS_TSC
+    tsc = __rdtsc() - tsc;
+#endif
+    auto stop = std::chrono::steady_clock::now();
+    sink = acc;
+
+    double calls = double(REPEATS) * a.size();
+    Timing t;
+    t.ns = std::chrono::duration<double, std::nano>(stop - start).count() / calls;
+#ifdef BENCH_HAS_TSC
+    t.ticks = tsc / calls;
+#else
+    t.ticks = 0.0;
+#endif
+    return t;
+}
+
+template <typename F, typename G>
+double maxError(const std::vector<float>& a, const std::vector<float>& b, F f, G reference, bool relative) {
+    double worst = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        double expected = reference(a[i], b[i]);
+        double error = std::fabs(double(f(a[i], b[i])) - expected);
+        if (relative)
+            error /= std::fabs(expected);
+        if (error > worst)
+            worst = error;
+    }
+    return worst;
+}
+
+void report(const char* name, double error, const char* unit, Timing fast, Timing libf, Timing libd) {
+    printf("%-10s max error %.3g %-4s | fastmath %6.2f ns %6.1f ticks | libm float %6.2f ns %6.1f ticks | libm double %6.2f ns %6.1f ticks\n", name, error, unit, fast.ns, fast.ticks, libf.ns, libf.ticks,
+           libd.ns, libd.ticks);
+}
+
+const double PI = 3.14159265358979323846;
+const double RAD_TO_DEG = 180.0 / PI;
+
+float nextFloat(float x) {
+    uint32_t i;
+    memcpy(&i, &x, sizeof(i));
+    ++i;
+    memcpy(&x, &i, sizeof(x));
+    return x;
+}
+
+// difference of two angles, wrapped to [-pi, pi]
+double angleError(double angle, double reference) {
+    double error = std::remainder(angle - reference, 2.0 * PI);
+    return std::fabs(error);
+}
+
+struct Worst {
+    double error{0.0};
+    double at_a{0.0};
+    double at_b{0.0};
+
+    void update(double e, double a, double b) {
+        if (e > error) {
+            error = e;
+            at_a = a;
+            at_b = b;
+        }
+    }
+};
+
+void reportAngle(const char* name, const Worst& worst, const char* where) {
+    printf("%-16s max angle error %.3g rad = %.3g deg, %s\n", name, worst.error, worst.error * RAD_TO_DEG, where);
+}
+
+// every float in [0, 1]
+template <typename F, typename G>
+Worst sweepUnitInterval(F f, G reference) {
+    Worst worst;
+    for (float x = 0.0f; x <= 1.0f; x = nextFloat(x))
+        worst.update(angleError(f(x), reference(double(x))), x, 0.0);
+    return worst;
+}
+
+Worst sweepAtan2() {
+    Worst worst;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> turn(-PI, PI);
+    std::uniform_real_distribution<double> decade(-30.0, 30.0);
+    auto check = [&worst](float y, float x) { worst.update(angleError(fast_atan2(y, x), std::atan2(double(y), double(x))), y, x); };
+
+    // both axes and the diagonals, with either sign of zero
+    const float magnitudes[]{1e-30f, 1e-10f, 1.0f, 1e10f, 1e30f};
+    for (float m : magnitudes) {
+        const float axes[][2]{{0.0f, m}, {0.0f, -m}, {-0.0f, m}, {-0.0f, -m}, {m, 0.0f}, {-m, 0.0f}, {m, -0.0f}, {-m, -0.0f}, {m, m}, {-m, m}, {m, -m}, {-m, -m}};
+        for (auto& p : axes)
+            check(p[0], p[1]);
+    }
+
+    // random directions and radii, with the two components also of independent magnitude
+    for (int i = 0; i < 10 * SWEEP; ++i) {
+        double angle = turn(rng);
+        double radius = std::pow(10.0, decade(rng));
+        check(float(radius * std::sin(angle)), float(radius * std::cos(angle)));
+        check(float(std::pow(10.0, decade(rng)) * std::sin(angle)), float(std::pow(10.0, decade(rng)) * std::cos(angle)));
+    }
+    return worst;
+}
+
+// the conversion in State::updateStateIMU; keep in sync with state.cpp
+// the rotation matrix entries are rounded to float either way, so the libm reference starts from the same entries
+void eulerAngles(const float q[4], float angle[3], double reference[3]) {
+    float r11 = 2.0f * (q[2] * q[3] + q[1] * q[0]);
+    float r12 = q[1] * q[1] + q[2] * q[2] - q[3] * q[3] - q[0] * q[0];
+    float r21 = -2.0f * (q[2] * q[0] - q[1] * q[3]);
+    float r31 = 2.0f * (q[3] * q[0] + q[1] * q[2]);
+    float r32 = q[1] * q[1] - q[2] * q[2] - q[3] * q[3] + q[0] * q[0];
+    angle[0] = -fast_atan2(r11, r12);
+    angle[1] = fast_asin(r21);
+    angle[2] = -fast_atan2(r31, r32);
+    reference[0] = -std::atan2(double(r11), double(r12));
+    reference[1] = std::asin(std::fmax(-1.0, std::fmin(1.0, double(r21))));
+    reference[2] = -std::atan2(double(r31), double(r32));
+}
+
+void sweepEuler(double max_pitch_offset, Worst (&worst)[3]) {
+    std::mt19937 rng(2);
+    std::normal_distribution<double> normal;
+    std::uniform_real_distribution<double> turn(-PI, PI);
+    std::uniform_real_distribution<double> offset(-max_pitch_offset, max_pitch_offset);
+    for (int i = 0; i < 10 * SWEEP; ++i) {
+        double qd[4];
+        if (max_pitch_offset > 0.0) {
+            // yaw, then pitch within max_pitch_offset of +-90 degrees, then roll
+            double yaw = turn(rng), roll = turn(rng);
+            double pitch = (i % 2 ? 1.0 : -1.0) * (0.5 * PI - std::fabs(offset(rng)));
+            double cy = std::cos(yaw / 2), sy = std::sin(yaw / 2), cp = std::cos(pitch / 2), sp = std::sin(pitch / 2), cr = std::cos(roll / 2), sr = std::sin(roll / 2);
+            qd[0] = cr * cp * cy + sr * sp * sy;
+            qd[1] = sr * cp * cy - cr * sp * sy;
+            qd[2] = cr * sp * cy + sr * cp * sy;
+            qd[3] = cr * cp * sy - sr * sp * cy;
+        } else {
+            // uniform over all attitudes
+            double norm = 0.0;
+            for (double& c : qd) {
+                c = normal(rng);
+                norm += c * c;
+            }
+            for (double& c : qd)
+                c /= std::sqrt(norm);
+        }
+        const float q[4]{float(qd[0]), float(qd[1]), float(qd[2]), float(qd[3])};
+        float angle[3];
+        double reference[3];
+        eulerAngles(q, angle, reference);
+        for (int a = 0; a < 3; ++a)
+            worst[a].update(angleError(angle[a], reference[a]), reference[1] * RAD_TO_DEG, 0.0);
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::vector<float> x(SWEEP), y(SWEEP), unit(SWEEP), positive(SWEEP);
+    for (int i = 0; i < SWEEP; ++i) {
+        float t = float(i) / (SWEEP - 1);
+        // atan2 sweeps the whole circle at varying radius
+        float angle = -3.14159265f + 6.28318531f * t;
+        float radius = 0.01f + 10.0f * float((i * 7919LL) % SWEEP) / SWEEP;
+        x[i] = radius * std::cos(angle);
+        y[i] = radius * std::sin(angle);
+        unit[i] = -1.0f + 2.0f * t;
+        // inv_sqrt covers the magnitudes seen by normalize(): squared gravity in g, squared field in uT, quaternion norms
+        positive[i] = std::pow(10.0f, -4.0f + 8.0f * t);
+    }
+
+    report("atan2", maxError(y, x, [](float a, float b) { return fast_atan2(a, b); }, [](float a, float b) { return std::atan2(double(a), double(b)); }, false), "rad",
+           timeCalls(y, x, [](float a, float b) { return fast_atan2(a, b); }), timeCalls(y, x, [](float a, float b) { return atan2f(a, b); }),
+           timeCalls(y, x, [](float a, float b) { return float(atan2(double(a), double(b))); }));
+
+    report("asin", maxError(unit, unit, [](float a, float) { return fast_asin(a); }, [](float a, float) { return std::asin(double(a)); }, false), "rad",
+           timeCalls(unit, unit, [](float a, float) { return fast_asin(a); }), timeCalls(unit, unit, [](float a, float) { return asinf(a); }),
+           timeCalls(unit, unit, [](float a, float) { return float(asin(double(a))); }));
+
+    report("inv_sqrt", maxError(positive, positive, [](float a, float) { return inv_sqrt(a); }, [](float a, float) { return 1.0 / std::sqrt(double(a)); }, true), "rel",
+           timeCalls(positive, positive, [](float a, float) { return inv_sqrt(a); }), timeCalls(positive, positive, [](float a, float) { return 1.0f / sqrtf(a); }),
+           timeCalls(positive, positive, [](float a, float) { return float(1.0 / sqrt(double(a))); }));
+
+    printf("\nfull domain sweeps\n");
+    Worst unit_worst = sweepUnitInterval([](float a) { return fast_atan_unit(a); }, [](double a) { return std::atan(a); });
+    char where[96];
+    snprintf(where, sizeof(where), "every float in [0, 1], worst at x = %.9g", unit_worst.at_a);
+    reportAngle("fast_atan_unit", unit_worst, where);
+
+    Worst asin_worst = sweepUnitInterval([](float a) { return fast_asin(a); }, [](double a) { return std::asin(a); });
+    snprintf(where, sizeof(where), "every float in [0, 1], worst at x = %.9g", asin_worst.at_a);
+    reportAngle("fast_asin", asin_worst, where);
+
+    Worst atan2_worst = sweepAtan2();
+    snprintf(where, sizeof(where), "all quadrants and axes, worst at y = %.3g, x = %.3g", atan2_worst.at_a, atan2_worst.at_b);
+    reportAngle("fast_atan2", atan2_worst, where);
+
+    const char* euler_names[3]{"Euler roll", "Euler pitch", "Euler yaw"};
+    Worst euler_worst[3];
+    sweepEuler(0.0, euler_worst);
+    for (int a = 0; a < 3; ++a) {
+        snprintf(where, sizeof(where), "random attitudes, worst at pitch %.4g deg", euler_worst[a].at_a);
+        reportAngle(euler_names[a], euler_worst[a], where);
+    }
+    Worst gimbal_worst[3];
+    sweepEuler(1e-3, gimbal_worst);
+    for (int a = 0; a < 3; ++a) {
+        snprintf(where, sizeof(where), "pitch within 1 mrad of +-90 deg, worst at pitch %.6g deg", gimbal_worst[a].at_a);
+        reportAngle(euler_names[a], gimbal_worst[a], where);
+    }
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <inv_sqrt_drift.cpp>
+
+    Host harness for the inv_sqrt paths in fastmath.h.
+
+    Runs the Madgwick and Mahony filters for a million steps at 500 Hz on a stationary, level vehicle with noisy gyro and
+    accelerometer readings, and reports the worst quaternion norm error and the worst tilt away from level. A second run
+    feeds exact level readings, which zero the Madgwick gradient, and checks that the estimate stays finite.
+
+    inv_sqrt is selected at compile time, so build once per path from the repository root:
+
+        g++ -std=gnu++11 -O2 -I. bench/inv_sqrt_drift.cpp ahrs.cpp -o drift && ./drift
+        g++ -std=gnu++11 -O2 -I. -DFASTMATH_INV_SQRT_NEWTON bench/inv_sqrt_drift.cpp ahrs.cpp -o drift && ./drift
+        g++ -std=gnu++11 -O2 -I. -DFASTMATH_INV_SQRT_SSE bench/inv_sqrt_drift.cpp ahrs.cpp -o drift && ./drift
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include "ahrs.h"
+
+namespace {
+
+const int STEPS = 1000000;
+const float DELTA_TIME = 0.002f;
+const float GYRO_NOISE = 0.05f;  // rad/s
+const float ACC_NOISE = 0.02f;   // g
+
+const char* PATH_NAME =
+#if defined(FASTMATH_INV_SQRT_SSE)
+    "sse";
+#elif defined(FASTMATH_INV_SQRT_NEWTON)
+    "newton";
+#else
+    "hardware";
+#endif
+
+enum class Filter { Madgwick, Mahony };
+
+struct Drift {
+    double norm_error;
+    double tilt;
+    bool finite;
+};
+
+Drift run(Filter filter, bool noisy) {
+    float q[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+    float fb_i[3] = {0.0f, 0.0f, 0.0f};
+    std::mt19937 generator(3);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    float gyro_scale = noisy ? GYRO_NOISE : 0.0f;
+    float acc_scale = noisy ? ACC_NOISE : 0.0f;
+
+    Drift drift = {0.0, 0.0, true};
+    for (int i = 0; i < STEPS; ++i) {
+        float gx = gyro_scale * noise(generator);
+        float gy = gyro_scale * noise(generator);
+        float gz = gyro_scale * noise(generator);
+        float ax = acc_scale * noise(generator);
+        float ay = acc_scale * noise(generator);
+        float az = 1.0f + acc_scale * noise(generator);
+
+        if (filter == Filter::Madgwick)
+            se_madgwick_ahrs_update_imu(gx, gy, gz, ax, ay, az, DELTA_TIME, 0.1f, q);
+        else
+            se_mahony_ahrs_update_imu(gx, gy, gz, ax, ay, az, DELTA_TIME, 0.02f, 2.0f, fb_i, q);
+
+        if (!(std::isfinite(q[0]) && std::isfinite(q[1]) && std::isfinite(q[2]) && std::isfinite(q[3]))) {
+            drift.finite = false;
+            break;
+        }
+
+        double norm = std::sqrt(double(q[0]) * q[0] + double(q[1]) * q[1] + double(q[2]) * q[2] + double(q[3]) * q[3]);
+        drift.norm_error = std::fmax(drift.norm_error, std::fabs(norm - 1.0));
+        // angle between the body z axis and vertical
+        double cos_tilt = (double(q[0]) * q[0] - double(q[1]) * q[1] - double(q[2]) * q[2] + double(q[3]) * q[3]) / (norm * norm);
+        drift.tilt = std::fmax(drift.tilt, std::acos(std::fmin(1.0, std::fmax(-1.0, cos_tilt))));
+    }
+    return drift;
+}
+
+void report(const char* name, Filter filter) {
+    Drift noisy = run(filter, true);
+    Drift level = run(filter, false);
+    printf("%-8s %-8s | noisy: max ||q|-1| %.3g, max tilt %.4f deg%s | level: max ||q|-1| %.3g%s\n", PATH_NAME, name, noisy.norm_error, noisy.tilt * 180.0 / M_PI, noisy.finite ? "" : ", NOT FINITE",
+           level.norm_error, level.finite ? "" : ", NOT FINITE");
+}
+
+}  // namespace
+
+int main() {
+    report("madgwick", Filter::Madgwick);
+    report("mahony", Filter::Mahony);
+    return 0;
+}
@@ -0,0 +1,215 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <kalman_bench.cpp>
+
+    Host benchmark of the hand-unrolled altitude Kalman kernels in kalman.cpp against the generic lapack.cpp path.
+
+    The lapack path is the pre-unrolling implementation, extended from 3 to the current 4 states [p, v, a, b]: F P F' is
+    formed with two Fgemm_ calls and K H P with one rank-1 Fgemm_. Both run the same input sequence, shaped like
+    Localization: a 500 Hz accelerometer correction, and a 50 Hz barometer correction halfway between two of them, from the
+    same uninformed elevation variance of 1e30. It reports the largest state and covariance difference, relative to
+    the size of the entry for entries above 1 and absolute below, and the time per predict and per correct of each path.
+
+    Build and run from the repository root:
+
+        g++ -std=gnu++11 -O2 -I. bench/kalman_bench.cpp kalman.cpp lapack.cpp -o kalman_bench && ./kalman_bench
+
+    Host timings only rank the variants; cycle counts for the Cortex-M4F have to be taken on the target.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "kalman.h"
+#include "lapack.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+namespace {
+
+const int STEPS = 1000000;
+const int REPEATS = 5;
+const float DELTA_TIME = 0.002f;
+const int BARO_DIVIDER = 10;
+
+// keep in sync with localization.cpp and state.cpp
+const float ACC_VARIANCE = 0.01f;
+const float ACC_BIAS_VARIANCE = 0.25f;
+const float BARO_VARIANCE = 1e-3f;
+
+// the lapack.cpp path, column major
+void lapackPredict(float deltaTime, float* state, float* covar) {
+    float F[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    static const float Q[16] = {0.06f, 0.0f, 0.0f, 0.0f, 0.0f, 0.04f, 0.0f, 0.0f, 0.0f, 0.0f, 0.01f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0004f};
+    static const int n = 4;
+    static const float f_one = 1.0f, f_zero = 0.0f;
+    float buffer[16];
+
+    if (!(deltaTime > 0.0f))
+        return;
+
+    F[4] = deltaTime;
+    F[8] = deltaTime * deltaTime * 0.5f;
+    F[12] = -F[8];
+    F[9] = deltaTime;
+    F[13] = -deltaTime;
+    const float accel = state[2] - state[3];
+    state[0] += F[4] * state[1] + F[8] * accel;
+    state[1] += F[9] * accel;
+
+    /* buffer = P * F' */
+    Fgemm_("n", "t", &n, &n, &n, &f_one, covar, &n, F, &n, &f_zero, buffer, &n);
+
+    /* P = Q */
+    Flacpy_(" ", &n, &n, Q, &n, covar, &n);
+
+    /* P = F * buffer + dT * P = F * P * F' + dt * Q */
+    Fgemm_("n", "n", &n, &n, &n, &f_one, F, &n, buffer, &n, &deltaTime, covar, &n);
+}
+
+void lapackCorrect(float* state, float* covar, int coordinate, float value, float variance) {
+    static const int n = 4, i_one = 1;
+    static const float f_one = 1.0f, f_minus_one = -1.0f;
+    float y = value - state[coordinate];
+    float k_opt[4], h_row[4];
+    float s_inverse = 1.0f / (covar[coordinate * 5] + variance);
+    for (int i = 0; i < 4; ++i) {
+        k_opt[i] = covar[i + coordinate * 4] * s_inverse;
+        state[i] += k_opt[i] * y;
+        h_row[i] = covar[coordinate + 4 * i];
+    }
+    /* P -= K * H * P */
+    Fgemm_("n", "n", &n, &n, &i_one, &f_minus_one, k_opt, &n, h_row, &i_one, &f_one, covar, &n);
+}
+
+struct Step {
+    float delta_time;
+    int coordinate;
+    float value;
+    float variance;
+};
+
+// a vertical sine with a constant accelerometer bias, sampled by a noisy accelerometer and barometer
+std::vector<Step> makeSequence() {
+    std::mt19937 rng(3);
+    std::normal_distribution<float> acc_noise(0.0f, 0.1f);
+    std::normal_distribution<float> baro_noise(0.0f, 0.03f);
+    std::vector<Step> steps;
+    for (int i = 0; i < STEPS; ++i) {
+        double t = i * DELTA_TIME;
+        float acceleration = float(-2.0 * 0.09 * std::sin(0.3 * t));
+        if (i % BARO_DIVIDER == 0) {
+            steps.push_back({DELTA_TIME / 2, 0, float(2.0 * std::sin(0.3 * t)) + baro_noise(rng), BARO_VARIANCE});
+            steps.push_back({DELTA_TIME / 2, 2, acceleration + 0.3f + acc_noise(rng), ACC_VARIANCE});
+        } else {
+            steps.push_back({DELTA_TIME, 2, acceleration + 0.3f + acc_noise(rng), ACC_VARIANCE});
+        }
+    }
+    return steps;
+}
+
+struct Filters {
+    float z_unrolled[4]{0.0f, 0.0f, 0.0f, 0.0f};
+    Matrix<float, 4, 4> p_unrolled{{{1e30f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.01f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.01f, 0.0f}, {0.0f, 0.0f, 0.0f, ACC_BIAS_VARIANCE}}};
+    float z_lapack[4]{0.0f, 0.0f, 0.0f, 0.0f};
+    float p_lapack[16]{1e30f, 0.0f, 0.0f, 0.0f, 0.0f, 0.01f, 0.0f, 0.0f, 0.0f, 0.0f, 0.01f, 0.0f, 0.0f, 0.0f, 0.0f, ACC_BIAS_VARIANCE};
+};
+
+double relativeDifference(float a, float b) {
+    return std::fabs(double(a) - double(b)) / std::max(1.0, std::fabs(double(b)));
+}
+
+struct Timing {
+    double ns;
+    double ticks;
+};
+
+template <typename F>
+Timing timeCalls(size_t calls_per_repeat, F f) {
+    auto start = std::chrono::steady_clock::now();
+#ifdef BENCH_HAS_TSC
+    unsigned long long tsc = __rdtsc();
+#endif
+    for (int r = 0; r < REPEATS; ++r)
+        f();
+#ifdef BENCH_HAS_TSC
+    tsc = __rdtsc() - tsc;
+#endif
+    auto stop = std::chrono::steady_clock::now();
+
+    double calls = double(REPEATS) * calls_per_repeat;
+    Timing t;
+    t.ns = std::chrono::duration<double, std::nano>(stop - start).count() / calls;
+#ifdef BENCH_HAS_TSC
+    t.ticks = tsc / calls;
+#else
+    t.ticks = 0.0;
+#endif
+    return t;
+}
+
+volatile float sink;
+
+}  // namespace
+
+int main() {
+    const std::vector<Step> steps = makeSequence();
+
+    // both paths on the same sequence, compared after every step
+    Filters f;
+    double state_difference = 0.0;
+    double covariance_difference = 0.0;
+    for (const Step& s : steps) {
+        se_kalman_predict(s.delta_time, f.z_unrolled, f.p_unrolled);
+        se_kalman_correct(f.z_unrolled, f.p_unrolled, s.coordinate, s.value, s.variance);
+        lapackPredict(s.delta_time, f.z_lapack, f.p_lapack);
+        lapackCorrect(f.z_lapack, f.p_lapack, s.coordinate, s.value, s.variance);
+        for (int r = 0; r < 4; ++r) {
+            state_difference = std::max(state_difference, relativeDifference(f.z_unrolled[r], f.z_lapack[r]));
+            for (int c = 0; c < 4; ++c)
+                covariance_difference = std::max(covariance_difference, relativeDifference(f.p_unrolled.data[r][c], f.p_lapack[c * 4 + r]));
+        }
+    }
+    printf("%zu predict/correct pairs, %.0f s of flight\n", steps.size(), STEPS * DELTA_TIME);
+    printf("max relative difference: state %.3g, covariance %.3g\n", state_difference, covariance_difference);
+    printf("final state: unrolled p %.6f v %.6f a %.6f b %.6f | lapack p %.6f v %.6f a %.6f b %.6f\n", f.z_unrolled[0], f.z_unrolled[1], f.z_unrolled[2], f.z_unrolled[3], f.z_lapack[0],
+           f.z_lapack[1], f.z_lapack[2], f.z_lapack[3]);
+
+    // timing starts from the converged filters, each path on its own copy
+    const Filters converged = f;
+    Filters u = converged;
+    Filters l = converged;
+    Timing unrolled_predict = timeCalls(steps.size(), [&] {
+        for (const Step& s : steps)
+            se_kalman_predict(s.delta_time, u.z_unrolled, u.p_unrolled);
+    });
+    Timing lapack_predict = timeCalls(steps.size(), [&] {
+        for (const Step& s : steps)
+            lapackPredict(s.delta_time, l.z_lapack, l.p_lapack);
+    });
+    u = converged;
+    l = converged;
+    Timing unrolled_correct = timeCalls(steps.size(), [&] {
+        for (const Step& s : steps)
+            se_kalman_correct(u.z_unrolled, u.p_unrolled, s.coordinate, s.value, s.variance);
+    });
+    Timing lapack_correct = timeCalls(steps.size(), [&] {
+        for (const Step& s : steps)
+            lapackCorrect(l.z_lapack, l.p_lapack, s.coordinate, s.value, s.variance);
+    });
+    sink = u.z_unrolled[0] + u.p_unrolled.data[0][0] + l.z_lapack[0] + l.p_lapack[0];
+
+    printf("predict   unrolled %6.2f ns %6.1f ticks | lapack %6.2f ns %6.1f ticks\n", unrolled_predict.ns, unrolled_predict.ticks, lapack_predict.ns, lapack_predict.ticks);
+    printf("correct   unrolled %6.2f ns %6.1f ticks | lapack %6.2f ns %6.1f ticks\n", unrolled_correct.ns, unrolled_correct.ticks, lapack_correct.ns, lapack_correct.ticks);
+    return 0;
+}
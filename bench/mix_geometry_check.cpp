@@ -0,0 +1,70 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <mix_geometry_check.cpp>
+
+    Host check of the control allocation in allocation.cpp.
+
+    Builds the mix from the default motor geometry and compares it with the default mix table, entry by entry and
+    without tolerance, the way Airframe::buildMixMatrix normalizes the table. Both defaults are copied from
+    CONFIG_struct::CONFIG_struct() in config.cpp and must be kept in sync with it. Exits with 1 on any mismatch.
+
+    Build and run from the repository root:
+
+        g++ -std=gnu++11 -O2 -I. bench/mix_geometry_check.cpp allocation.cpp lapack.cpp -o mixcheck && ./mixcheck
+*/
+
+#include <cmath>
+#include <cstdio>
+
+#include "allocation.h"
+
+namespace {
+
+// default mix table, as fz, tx, ty, tz per channel
+const int MIX_TABLE[8][4]{
+    {1, 1, -1, 1}, {1, 1, 1, -1}, {1, 1, -1, -1}, {1, 1, 1, 1}, {1, -1, -1, 1}, {1, -1, 1, -1}, {1, -1, -1, -1}, {1, -1, 1, 1},
+};
+
+// default motor geometry
+const float POSITIONS[8][2]{{50.0f, 50.0f}, {-50.0f, 50.0f}, {50.0f, 50.0f}, {-50.0f, 50.0f},
+                            {50.0f, -50.0f}, {-50.0f, -50.0f}, {50.0f, -50.0f}, {-50.0f, -50.0f}};
+const int SPINS[8]{-1, 1, 1, -1, -1, 1, 1, -1};
+
+}  // namespace
+
+int main() {
+    Airframe::MotorGeometry geometry;
+    for (int motor = 0; motor < 8; ++motor) {
+        geometry.position[motor][0] = POSITIONS[motor][0];
+        geometry.position[motor][1] = POSITIONS[motor][1];
+        geometry.thrust[motor] = 1.0f;
+        geometry.torque[motor] = 1.0f;
+        geometry.spin[motor] = SPINS[motor];
+    }
+    geometry.enabled = 1;
+
+    const float no_offset[2]{0.0f, 0.0f};
+    float matrix[8][4];
+    if (!allocateMix(geometry, no_offset, matrix)) {
+        printf("default geometry is singular\n");
+        return 1;
+    }
+
+    int mismatches = 0;
+    float worst = 0.0f;
+    for (int motor = 0; motor < 8; ++motor) {
+        for (int axis = 0; axis < 4; ++axis) {
+            float error = fabsf(matrix[motor][axis] - MIX_TABLE[motor][axis]);
+            worst = fmaxf(worst, error);
+            if (error != 0.0f) {
+                printf("CH%d axis %d: geometry %+.9f, table %+d\n", motor, axis, matrix[motor][axis], MIX_TABLE[motor][axis]);
+                ++mismatches;
+            }
+        }
+    }
+    printf("%d mismatching entries, worst error %g\n", mismatches, worst);
+    return mismatches ? 1 : 0;
+}
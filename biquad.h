@@ -0,0 +1,83 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <biquad.h>
+
+    Second order IIR sections for filtering sensor channels at a fixed sample rate.
+
+    Coefficients follow the RBJ audio EQ cookbook and are normalized by a0.
+*/
+
+#ifndef BIQUAD_H
+#define BIQUAD_H
+
+#include <math.h>
+#include <stddef.h>
+
+struct BiquadCoefficients {
+    static BiquadCoefficients passthrough() {
+        return BiquadCoefficients{1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    }
+
+    // cutoff and sample_rate in Hz; cutoff must be below sample_rate / 2
+    static BiquadCoefficients lowPass(float cutoff, float sample_rate, float q) {
+        float w0 = 6.28318531f * cutoff / sample_rate;
+        float cosw0 = cosf(w0);
+        float alpha = sinf(w0) / (2.0f * q);
+        float norm = 1.0f / (1.0f + alpha);
+        float b = (1.0f - cosw0) * 0.5f * norm;
+        return BiquadCoefficients{b, 2.0f * b, b, -2.0f * cosw0 * norm, (1.0f - alpha) * norm};
+    }
+
+    // center and sample_rate in Hz; center must be below sample_rate / 2
+    static BiquadCoefficients notch(float center, float sample_rate, float q) {
+        float w0 = 6.28318531f * center / sample_rate;
+        float cosw0 = cosf(w0);
+        float alpha = sinf(w0) / (2.0f * q);
+        float norm = 1.0f / (1.0f + alpha);
+        return BiquadCoefficients{norm, -2.0f * cosw0 * norm, norm, -2.0f * cosw0 * norm, (1.0f - alpha) * norm};
+    }
+
+    float b0, b1, b2, a1, a2;
+};
+
+// N channels sharing one set of coefficients, in transposed direct form II
+// this form tolerates coefficients being retuned in small steps between samples
+template <size_t N>
+class Biquad {
+   public:
+    Biquad() : coefficients(BiquadCoefficients::passthrough()) {
+        reset();
+    }
+
+    void setCoefficients(const BiquadCoefficients& c) {
+        coefficients = c;
+    }
+
+    void reset() {
+        for (size_t i = 0; i < N; ++i) {
+            z1[i] = 0.0f;
+            z2[i] = 0.0f;
+        }
+    }
+
+    // filters one sample of every channel in place
+    void apply(float (&x)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            float in = x[i];
+            float out = coefficients.b0 * in + z1[i];
+            z1[i] = coefficients.b1 * in - coefficients.a1 * out + z2[i];
+            z2[i] = coefficients.b2 * in - coefficients.a2 * out;
+            x[i] = out;
+        }
+    }
+
+   private:
+    BiquadCoefficients coefficients;
+    float z1[N];
+    float z2[N];
+};
+
+#endif /* end of include guard: BIQUAD_H */
@@ -91,5 +91,6 @@ void PilotCommand::processCommands(void) {
     if (state->is(STATUS_OVERRIDE))
         blockEnabling = true;  // block enabling when we come out of pilot override
 
-    // in the future, this would be the place to look for other combination inputs or for AUX levels that mean something
+    // with profile switching on, AUX2 levels select the controller profile, see Control::calculateControlVectors
+    // in the future, this would be the place to look for other combination inputs
 }
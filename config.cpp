@@ -82,10 +82,42 @@ CONFIG_struct::CONFIG_struct() {  // Default Settings
     mix_table.ty[7] = 1;
     mix_table.tz[7] = 1;
 
+    // the same mix by geometry, reproducing the table exactly (checked by bench/mix_geometry_check.cpp); only used when enabled
+    // each pair of motors sharing a table row is placed at the corner the row implies; enter the real positions to build the mix from them
+    const float positions[8][2]{{50.0f, 50.0f}, {-50.0f, 50.0f}, {50.0f, 50.0f}, {-50.0f, 50.0f},
+                                {50.0f, -50.0f}, {-50.0f, -50.0f}, {50.0f, -50.0f}, {-50.0f, -50.0f}};  // mm
+    const int8_t spins[8]{-1, 1, 1, -1, -1, 1, 1, -1};  // tz of the table is -spin
+    for (size_t motor = 0; motor < 8; ++motor) {
+        motor_geometry.position[motor][0] = positions[motor][0];
+        motor_geometry.position[motor][1] = positions[motor][1];
+        motor_geometry.thrust[motor] = 1.0f;
+        motor_geometry.torque[motor] = 1.0f;
+        motor_geometry.spin[motor] = spins[motor];
+    }
+    motor_geometry.enabled = 0;  // use the mix table
+
+    motor_settings.protocol = static_cast<uint8_t>(Motors::Protocol::PWM);  // brushed motors
+
     mag_bias.x = 0.0f;  // Bx (milligauss)
     mag_bias.y = 0.0f;  // By (milligauss)
     mag_bias.z = 0.0f;  // Bz (milligauss)
 
+    mag_soft_iron.matrix = Matrix<float, 3, 3>::identity();
+
+    bmp_settings.pressure_oversampling = 5;     // x16
+    bmp_settings.temperature_oversampling = 2;  // x2
+    bmp_settings.filter = 4;                    // IIR coefficient 16
+
+    mpu_settings.gyro_filter = 1;   // 184Hz
+    mpu_settings.accel_filter = 6;  // 5Hz
+    mpu_settings.gyro_range = 2;    // +/- 1000 deg/s
+    mpu_settings.accel_range = 2;   // +/- 8g
+    mpu_settings.gyro_lowpass = 0.0f;
+    mpu_settings.notch_min = 0.0f;
+    mpu_settings.notch_max = 0.0f;
+    mpu_settings.notch_q = 3.0f;
+    mpu_settings.notch_source = 0;  // motor output
+
     // RX -- PKZ3341 sends: RHS left/right, RHS up/down, LHS up/down, LHS
     // left/right, RHS click (latch), LHS button(momentary)
     channel.assignment[0] = 2;  // map throttle to LHS up/down
@@ -113,7 +145,8 @@ CONFIG_struct::CONFIG_struct() {  // Default Settings
 
     // PID Parameters
 
-    pid_parameters.thrust_master[0] = 1.0f;    // P
+    // the thrust controllers are bypassed unless enabled in pid_bypass or by the altitude hold profile
+    pid_parameters.thrust_master[0] = 1.0f;    // P (meters/sec per meter)
     pid_parameters.thrust_master[1] = 0.0f;    // I
     pid_parameters.thrust_master[2] = 0.0f;    // D
     pid_parameters.thrust_master[3] = 0.0f;    // Windup guard
@@ -145,10 +178,10 @@ CONFIG_struct::CONFIG_struct() {  // Default Settings
     pid_parameters.yaw_master[5] = 0.005f;  // setpoint filter usec (30Hz)
     pid_parameters.yaw_master[6] = 180.0f;  // (degrees / full stick action)
 
-    pid_parameters.thrust_slave[0] = 1.0f;    // P
-    pid_parameters.thrust_slave[1] = 0.0f;    // I
+    pid_parameters.thrust_slave[0] = 400.0f;  // P (thrust per meters/sec)
+    pid_parameters.thrust_slave[1] = 100.0f;  // I
     pid_parameters.thrust_slave[2] = 0.0f;    // D
-    pid_parameters.thrust_slave[3] = 10.0f;   // Windup guard
+    pid_parameters.thrust_slave[3] = 400.0f;  // Windup guard
     pid_parameters.thrust_slave[4] = 0.001f;  // D filter usec (150Hz)
     pid_parameters.thrust_slave[5] = 0.001f;  // setpoint filter usec (300Hz)
     pid_parameters.thrust_slave[6] = 0.3f;  // (meters/sec / full stick action)
@@ -180,12 +213,27 @@ CONFIG_struct::CONFIG_struct() {  // Default Settings
     pid_parameters.pid_bypass = BYPASS_THRUST_MASTER | BYPASS_THRUST_SLAVE |
                                 BYPASS_YAW_MASTER;  // AHRS/Horizon mode
 
+    pid_parameters.profile_switching = 0;  // AUX2 does not change the profile
+
+    for (size_t axis = 0; axis < 4; ++axis) {
+        slave_shaping.feed_forward[axis] = 0.0f;      // off
+        slave_shaping.d_filter_delay[axis] = 0.001f;  // D filter usec (150Hz)
+    }
+    slave_shaping.d_on_measurement = 0;  // D on error, as before
+
+    gain_schedule.tpa_breakpoint = 0.5f;
+    gain_schedule.tpa_rate = 0.0f;         // TPA off
+    gain_schedule.nominal_voltage = 0.0f;  // voltage compensation off; 3.7 V for the stock 1S pack
+    gain_schedule.voltage_limit = 1.3f;
+
     state_parameters.state_estimation[0] = 1.00f;  // 2*kp or BETA
     state_parameters.state_estimation[1] = 0.01f;  // 2*ki
 
     state_parameters.enable[0] = 0.001f;  // max variance
     state_parameters.enable[1] = 30.0f;   // max angle
 
+    state_parameters.filter_type = static_cast<uint8_t>(FilterType::Madgwick);
+
     led_states = LED::States{{
         LED::StateCase(STATUS_MPU_FAIL, LED::SOLID, CRGB::Black, CRGB::Red,
                        true),
@@ -216,15 +264,29 @@ CONFIG_struct::CONFIG_struct(Systems& sys)
       channel(sys.receiver.channel),
       pid_parameters(sys.control.pid_parameters),
       state_parameters(sys.state.parameters),
-      led_states(sys.led.states) {
+      led_states(sys.led.states),
+      mag_soft_iron(sys.mag.mag_soft_iron),
+      bmp_settings(sys.bmp.settings),
+      mpu_settings(sys.mpu.settings),
+      slave_shaping(sys.control.slave_shaping),
+      gain_schedule(sys.control.gain_schedule),
+      motor_geometry(sys.airframe.motor_geometry),
+      motor_settings(sys.motors.getSettings()) {
 }
 
 void CONFIG_struct::applyTo(Systems& systems) const {
-    systems.airframe.mix_table = mix_table;
+    systems.airframe.setMixTable(mix_table);
+    systems.airframe.setMotorGeometry(motor_geometry, pcb.translation);
+    systems.motors.setSettings(motor_settings);
     systems.mag.mag_bias = mag_bias;
+    systems.mag.mag_soft_iron = mag_soft_iron;
+    systems.bmp.settings = bmp_settings;
+    systems.mpu.settings = mpu_settings;
     systems.receiver.channel = channel;
     systems.state.parameters = state_parameters;
 
+    systems.control.slave_shaping = slave_shaping;
+    systems.control.gain_schedule = gain_schedule;
     systems.control.parseConfig(pid_parameters);
     systems.led.parseConfig(led_states);
     systems.id = id;
@@ -243,7 +305,8 @@ bool verifyArgs(T& var, TArgs&... varArgs) {
 
 bool CONFIG_struct::verify() const {
     return verifyArgs(version, pcb, mix_table, mag_bias, channel,
-                      pid_parameters, state_parameters, led_states, id);
+                      pid_parameters, state_parameters, led_states, id,
+                      mag_soft_iron, bmp_settings, mpu_settings, slave_shaping, gain_schedule, motor_geometry, motor_settings);
 }
 
 void writeEEPROM(const CONFIG_union& CONFIG) {
@@ -20,10 +20,13 @@
 #include <EEPROM.h>
 
 #include "AK8963.h"
+#include "BMP280.h"
+#include "MPU9250.h"
 #include "R415X.h"
 #include "airframe.h"
 #include "control.h"
 #include "led.h"
+#include "motors.h"
 #include "state.h"
 #include "version.h"
 
@@ -67,6 +70,13 @@ struct __attribute__((packed)) CONFIG_struct {
         PID_PARAMETERS = 1 << 6,
         STATE_PARAMETERS = 1 << 7,
         LED_STATES = 1 << 8,
+        MAG_SOFT_IRON = 1 << 9,
+        BMP_SETTINGS = 1 << 10,
+        MPU_SETTINGS = 1 << 11,
+        SLAVE_SHAPING = 1 << 12,
+        GAIN_SCHEDULE = 1 << 13,
+        MOTOR_GEOMETRY = 1 << 14,
+        MOTOR_SETTINGS = 1 << 15,
     };
 
     CONFIG_struct();
@@ -83,6 +93,13 @@ struct __attribute__((packed)) CONFIG_struct {
     Control::PIDParameters pid_parameters;
     State::Parameters state_parameters;
     LED::States led_states;
+    AK8963::MagSoftIron mag_soft_iron;
+    BMP280::Settings bmp_settings;
+    MPU9250::Settings mpu_settings;
+    Control::SlaveShaping slave_shaping;
+    Control::GainSchedule gain_schedule;
+    Airframe::MotorGeometry motor_geometry;
+    Motors::Settings motor_settings;
 };
 
 static_assert(sizeof(CONFIG_struct) ==
@@ -90,10 +107,14 @@ static_assert(sizeof(CONFIG_struct) ==
                       sizeof(Airframe::MixTable) + sizeof(AK8963::MagBias) +
                       sizeof(R415X::ChannelProperties) +
                       sizeof(State::Parameters) +
-                      sizeof(Control::PIDParameters) + sizeof(LED::States),
+                      sizeof(Control::PIDParameters) + sizeof(LED::States) +
+                      sizeof(AK8963::MagSoftIron) + sizeof(BMP280::Settings) +
+                      sizeof(MPU9250::Settings) + sizeof(Control::SlaveShaping) +
+                      sizeof(Control::GainSchedule) +
+                      sizeof(Airframe::MotorGeometry) + sizeof(Motors::Settings),
               "Data is not packed");
 
-static_assert(sizeof(CONFIG_struct) == 619, "Data does not have expected size");
+static_assert(sizeof(CONFIG_struct) == 868, "Data does not have expected size");
 
 union CONFIG_union {
     CONFIG_union() : data{CONFIG_struct()} {
@@ -8,91 +8,229 @@
 #include "debug.h"
 #include "state.h"
 
-namespace {
-enum PID_ID {
-    THRUST_MASTER = 0,
-    PITCH_MASTER = 1,
-    ROLL_MASTER = 2,
-    YAW_MASTER = 3,
-    THRUST_SLAVE = 4,
-    PITCH_SLAVE = 5,
-    ROLL_SLAVE = 6,
-    YAW_SLAVE = 7,
-};
-}
-
 Control::Control(State* __state, const PIDParameters& config)
     : state(__state),
       pid_parameters(config),
-      thrust_pid{config.thrust_master, config.thrust_slave},
-      pitch_pid{config.pitch_master, config.pitch_slave},
-      roll_pid{config.roll_master, config.roll_slave},
-      yaw_pid{config.yaw_master, config.yaw_slave} {
+      slave_shaping{{0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, 0},
+      gain_schedule{0.5f, 0.0f, 0.0f, 1.0f} {
     parseConfig(pid_parameters);
+#ifdef CONTROL_BENCHMARK
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
 }
 
 bool Control::PIDParameters::verify() const {
-    bool retval{true};
-    if (!(pid_bypass & (1 << THRUST_SLAVE))) {
-        // If the thrust slave is enabled
-        DebugPrint("The slave PID of the thrust regulator must be disabled for now");
-        retval = false;
+    if (profile_switching > 1) {
+        DebugPrint("Profile switching must be 0 (off) or 1 (AUX2 selects the profile)");
+        return false;
+    }
+    return true;
+}
+
+bool Control::SlaveShaping::verify() const {
+    bool ok{true};
+    for (uint8_t axis = 0; axis < 4; ++axis) {
+        if (!(d_filter_delay[axis] >= 0.0f)) {
+            DebugPrint("Slave D filter delays must not be negative");
+            ok = false;
+        }
+        if (isnan(feed_forward[axis]) || isinf(feed_forward[axis])) {
+            DebugPrint("Slave feed-forward gains must be finite");
+            ok = false;
+        }
+    }
+    if (d_on_measurement & 0xF0) {
+        DebugPrint("Only the lowest four bits of the slave D on measurement field are used");
+        ok = false;
+    }
+    return ok;
+}
+
+bool Control::GainSchedule::verify() const {
+    bool ok{true};
+    if (!(tpa_breakpoint >= 0.0f && tpa_breakpoint < 1.0f && tpa_rate >= 0.0f && tpa_rate <= 1.0f)) {
+        DebugPrint("TPA breakpoint must be within [0, 1) and rate within [0, 1]");
+        ok = false;
     }
-    return retval;
+    if (!(nominal_voltage >= 0.0f && voltage_limit >= 1.0f && voltage_limit <= 4.0f)) {
+        DebugPrint("Nominal voltage must not be negative and the voltage gain limit must be within [1, 4]");
+        ok = false;
+    }
+    return ok;
 }
 
 void Control::parseConfig(const PIDParameters& config) {
     pid_parameters = config;
 
-    thrust_pid = {pid_parameters.thrust_master, pid_parameters.thrust_slave};
-    pitch_pid = {pid_parameters.pitch_master, pid_parameters.pitch_slave};
-    roll_pid = {pid_parameters.roll_master, pid_parameters.roll_slave};
-    yaw_pid = {pid_parameters.yaw_master, pid_parameters.yaw_slave};
+    pids.configure(THRUST_MASTER, pid_parameters.thrust_master);
+    pids.configure(PITCH_MASTER, pid_parameters.pitch_master);
+    pids.configure(ROLL_MASTER, pid_parameters.roll_master);
+    pids.configure(YAW_MASTER, pid_parameters.yaw_master);
+    pids.configure(THRUST_SLAVE, pid_parameters.thrust_slave);
+    pids.configure(PITCH_SLAVE, pid_parameters.pitch_slave);
+    pids.configure(ROLL_SLAVE, pid_parameters.roll_slave);
+    pids.configure(YAW_SLAVE, pid_parameters.yaw_slave);
+
+    for (uint8_t axis = 0; axis < PID_AXES; ++axis)
+        pids.setShaping(PID_AXES + axis, slave_shaping.feed_forward[axis], slave_shaping.d_on_measurement & (1 << axis), slave_shaping.d_filter_delay[axis]);
+
+    bool* configured = profileEnabled[static_cast<uint8_t>(Profile::Configured)];
+    bool* rate = profileEnabled[static_cast<uint8_t>(Profile::Rate)];
+    bool* altitude = profileEnabled[static_cast<uint8_t>(Profile::AltitudeHold)];
+    for (uint8_t i = 0; i < 8; ++i) {
+        configured[i] = ((pid_parameters.pid_bypass & (1 << i)) == 0);
+        rate[i] = configured[i];
+        altitude[i] = configured[i];
+    }
+    rate[PITCH_MASTER] = rate[ROLL_MASTER] = rate[YAW_MASTER] = false;
+    rate[PITCH_SLAVE] = rate[ROLL_SLAVE] = rate[YAW_SLAVE] = true;
+    altitude[THRUST_MASTER] = altitude[THRUST_SLAVE] = true;
 
     for (uint8_t i = 0; i < 8; ++i)
-        pidEnabled[i] = ((pid_parameters.pid_bypass & (1 << i)) == 0);
+        pidEnabled[i] = profileEnabled[static_cast<uint8_t>(profile)][i];
 
     // all slaves are rate controllers; set up the master pids as wrapped angle controllers
-    pitch_pid.isMasterWrapped();
-    roll_pid.isMasterWrapped();
-    yaw_pid.isMasterWrapped();
-
-    thrust_pid.IntegralReset();
-    pitch_pid.IntegralReset();
-    roll_pid.IntegralReset();
-    yaw_pid.IntegralReset();
+    pids.isWrapped(PITCH_MASTER);
+    pids.isWrapped(ROLL_MASTER);
+    pids.isWrapped(YAW_MASTER);
+
+    pids.setTimestep(samplePeriod);
+
+    for (uint8_t k = 0; k < CONTROL_TPA_TABLE_SIZE; ++k) {
+        float thrust = k / (CONTROL_TPA_TABLE_SIZE - 1.0f);
+        float above = fmaxf(thrust - gain_schedule.tpa_breakpoint, 0.0f) / (1.0f - gain_schedule.tpa_breakpoint);
+        tpaTable[k] = 1.0f - gain_schedule.tpa_rate * above;
+    }
+    voltageFactor = 1.0f;
+
+    pids.IntegralReset();
+}
+
+void Control::setBatteryVoltage(float volts) {
+    if (gain_schedule.nominal_voltage == 0.0f || volts <= 0.0f) {
+        voltageFactor = 1.0f;
+        return;
+    }
+    voltageFactor = constrain(gain_schedule.nominal_voltage / volts, 1.0f / gain_schedule.voltage_limit, gain_schedule.voltage_limit);
+}
+
+void Control::setSampleRate(float hz) {
+    if (!(hz > 0.0f))
+        return;
+    float period = 1.0f / hz;
+    if (fabsf(period - samplePeriod) > CONTROL_PERIOD_TOLERANCE * samplePeriod) {
+        samplePeriod = period;
+        pids.setTimestep(samplePeriod);
+    }
+}
+
+void Control::setProfile(Profile next) {
+    if (next == profile)
+        return;
+
+    if (next == Profile::AltitudeHold) {
+        holdAltitude = state->kinematicsAltitude;
+        holdThrust = state->Fz;
+        holdThrottle = state->command_throttle;
+        releaseThrust = 0.0f;
+    }
+
+    // the hover thrust is fed forward in altitude hold, so the thrust slave starts from zero there,
+    // and thrust controllers that stay enabled when leaving it restart from the full thrust
+    const bool leaving_hold = (profile == Profile::AltitudeHold);
+    const bool* enabled = profileEnabled[static_cast<uint8_t>(next)];
+    float previous[PID_AXES]{(next == Profile::AltitudeHold) ? 0.0f : state->Fz, state->Tx, state->Ty, state->Tz};
+    for (uint8_t axis = 0; axis < PID_AXES; ++axis) {
+        uint8_t master = axis;
+        uint8_t slave = PID_AXES + axis;
+        const bool restart = leaving_hold && (axis == THRUST_MASTER);
+        if (enabled[slave] && (!pidEnabled[slave] || restart))
+            pids.engage(slave, previous[axis]);
+        // an engaged slave holds its input, so the master has to command what the slave is currently seeing
+        if (enabled[master] && (!pidEnabled[master] || restart))
+            pids.engage(master, enabled[slave] ? pids.desiredSetpoint(slave) : previous[axis]);
+    }
+
+    for (uint8_t i = 0; i < 8; ++i)
+        pidEnabled[i] = enabled[i];
+    profile = next;
 }
 
-void Control::calculateControlVectors() {
-    thrust_pid.setMasterInput(state->kinematicsAltitude);
-    thrust_pid.setSlaveInput(0.0f); //state->kinematicsClimbRate
-    pitch_pid.setMasterInput(state->kinematicsAngle[0] * 57.2957795f);
-    pitch_pid.setSlaveInput(state->kinematicsRate[0] * 57.2957795f);
-    roll_pid.setMasterInput(state->kinematicsAngle[1] * 57.2957795f);
-    roll_pid.setSlaveInput(state->kinematicsRate[1] * 57.2957795f);
-    yaw_pid.setMasterInput(state->kinematicsAngle[2] * 57.2957795f);
-    yaw_pid.setSlaveInput(state->kinematicsRate[2] * 57.2957795f);
-
-    thrust_pid.setSetpoint(state->command_throttle * (1.0f/4095.0f) * thrust_pid.getScalingFactor(pidEnabled[THRUST_MASTER], pidEnabled[THRUST_SLAVE], 4095.0f));
-    pitch_pid.setSetpoint(state->command_pitch * (1.0f/2047.0f) * pitch_pid.getScalingFactor(pidEnabled[PITCH_MASTER], pidEnabled[PITCH_SLAVE], 2047.0f));
-    roll_pid.setSetpoint(state->command_roll * (1.0f/2047.0f) * roll_pid.getScalingFactor(pidEnabled[ROLL_MASTER], pidEnabled[ROLL_SLAVE], 2047.0f));
-    yaw_pid.setSetpoint(state->command_yaw * (1.0f/2047.0f) * yaw_pid.getScalingFactor(pidEnabled[YAW_MASTER], pidEnabled[YAW_SLAVE], 2047.0f));
+void Control::calculateControlVectors(uint32_t now) {
+    // after a gap (first update, stalled sensor) the step length is unknown, so the integrals and derivatives hold
+    const bool resync = (now - lastUpdateMicros) * 0.000001f > 2.0f * samplePeriod;
+    lastUpdateMicros = now;
+    const float last_thrust = state->Fz;
+    const bool was_holding = (profile == Profile::AltitudeHold);
+
+    pids.setInput(THRUST_MASTER, state->kinematicsAltitude);
+    pids.setInput(THRUST_SLAVE, state->kinematicsClimbRate);
+    pids.setInput(PITCH_MASTER, state->kinematicsAngle[0] * 57.2957795f);
+    pids.setInput(PITCH_SLAVE, state->kinematicsRate[0] * 57.2957795f);
+    pids.setInput(ROLL_MASTER, state->kinematicsAngle[1] * 57.2957795f);
+    pids.setInput(ROLL_SLAVE, state->kinematicsRate[1] * 57.2957795f);
+    pids.setInput(YAW_MASTER, state->kinematicsAngle[2] * 57.2957795f);
+    pids.setInput(YAW_SLAVE, state->kinematicsRate[2] * 57.2957795f);
+
+    if (!pid_parameters.profile_switching)
+        setProfile(Profile::Configured);
+    else if (state->command_AUX_mask & (1 << 3))  // AUX2 is low
+        setProfile(Profile::Rate);
+    else if (state->command_AUX_mask & (1 << 5))  // AUX2 is high
+        setProfile(Profile::AltitudeHold);
+    else
+        setProfile(Profile::Configured);
+
+    // in altitude hold the throttle stick moves the target altitude relative to where it was latched
+    const bool holding = (profile == Profile::AltitudeHold);
+    float setpoint[PID_AXES]{
+        (holding ? holdAltitude : 0.0f) +
+        (state->command_throttle - (holding ? holdThrottle : 0)) * (1.0f/4095.0f) * pids.getScalingFactor(THRUST_MASTER, pidEnabled[THRUST_MASTER], pidEnabled[THRUST_SLAVE], 4095.0f),
+        state->command_pitch * (1.0f/2047.0f) * pids.getScalingFactor(PITCH_MASTER, pidEnabled[PITCH_MASTER], pidEnabled[PITCH_SLAVE], 2047.0f),
+        state->command_roll * (1.0f/2047.0f) * pids.getScalingFactor(ROLL_MASTER, pidEnabled[ROLL_MASTER], pidEnabled[ROLL_SLAVE], 2047.0f),
+        state->command_yaw * (1.0f/2047.0f) * pids.getScalingFactor(YAW_MASTER, pidEnabled[YAW_MASTER], pidEnabled[YAW_SLAVE], 2047.0f),
+    };
+
+    // gain scheduling on the thrust of the previous update
+    float tpa_index = constrain(state->Fz, 0.0f, 4095.0f) * ((CONTROL_TPA_TABLE_SIZE - 1) / 4095.0f);
+    uint8_t k = (tpa_index < CONTROL_TPA_TABLE_SIZE - 1) ? (uint8_t)tpa_index : CONTROL_TPA_TABLE_SIZE - 2;
+    float gain_scale = voltageFactor * (tpaTable[k] + (tpa_index - k) * (tpaTable[k + 1] - tpaTable[k]));
+    pids.setGainScale(PITCH_SLAVE, gain_scale);
+    pids.setGainScale(ROLL_SLAVE, gain_scale);
+    pids.setGainScale(YAW_SLAVE, gain_scale);
 
     // compute new output levels for state
-    uint32_t now = micros();
-    state->Fz = thrust_pid.Compute(now, pidEnabled[THRUST_MASTER], pidEnabled[THRUST_SLAVE]);
-    state->Tx = pitch_pid.Compute(now, pidEnabled[PITCH_MASTER], pidEnabled[PITCH_SLAVE]);
-    state->Ty = roll_pid.Compute(now, pidEnabled[ROLL_MASTER], pidEnabled[ROLL_SLAVE]);
-    state->Tz = yaw_pid.Compute(now, pidEnabled[YAW_MASTER], pidEnabled[YAW_SLAVE]);
+    float output[PID_AXES];
+#ifdef CONTROL_BENCHMARK
+    uint32_t cycles = ARM_DWT_CYCCNT;
+#endif
+    pids.Compute(now, setpoint, pidEnabled, output, !resync);
+#ifdef CONTROL_BENCHMARK
+    controlCycles = ARM_DWT_CYCCNT - cycles;
+#endif
+    state->Fz = output[THRUST_MASTER];
+    if (holding)  // a throttle cut still stops the motors
+        state->Fz = (state->command_throttle == 0) ? 0.0f : state->Fz + holdThrust;
+    else {
+        // whatever the new profile does not pick up of the hold thrust (a bypassed stick, the windup guard) is ramped out
+        if (was_holding)
+            releaseThrust = last_thrust - state->Fz;
+        if (state->command_throttle == 0)
+            releaseThrust = 0.0f;
+        state->Fz += releaseThrust;
+        const float release_step = CONTROL_HOLD_RELEASE_RATE * samplePeriod;
+        releaseThrust -= constrain(releaseThrust, -release_step, release_step);
+    }
+    state->Tx = output[PITCH_MASTER];
+    state->Ty = output[ROLL_MASTER];
+    state->Tz = output[YAW_MASTER];
 
     if (state->Fz == 0) {  // throttle is in low condition
         state->Tx = 0;
         state->Ty = 0;
         state->Tz = 0;
 
-        thrust_pid.IntegralReset();
-        pitch_pid.IntegralReset();
-        roll_pid.IntegralReset();
-        yaw_pid.IntegralReset();
+        pids.IntegralReset();
     }
 }
@@ -13,20 +13,52 @@
 #define control_h
 
 #include "Arduino.h"
-#include "cascadedPID.h"
+#include "pidBank.h"
 
-class PID;
 class CONFIG_struct;
 class State;
 
+#define CONTROL_UPDATE_PERIOD 2000  // microseconds; expected time between IMU samples, used until the sample rate is measured
+#define CONTROL_PERIOD_TOLERANCE 0.02f  // the controllers are recomputed when the measured period moves further than this fraction
+#define CONTROL_HOLD_RELEASE_RATE 1000.0f  // thrust per second at which the step left when leaving altitude hold is ramped out
+
+#define CONTROL_TPA_TABLE_SIZE 17  // TPA gains over the full thrust range, linearly interpolated
+
+// #define CONTROL_BENCHMARK  // count the cycles spent in the controller updates, using the DWT cycle counter
+
 class Control {
    public:
     struct PIDParameters;
 
+    enum PID_ID : uint8_t {
+        THRUST_MASTER = 0,
+        PITCH_MASTER = 1,
+        ROLL_MASTER = 2,
+        YAW_MASTER = 3,
+        THRUST_SLAVE = 4,
+        PITCH_SLAVE = 5,
+        ROLL_SLAVE = 6,
+        YAW_SLAVE = 7,
+    };
+
+    // controller profiles, selected in flight with AUX2 {low, mid, high} = {Rate, Configured, AltitudeHold} when profile_switching is set
+    enum class Profile : uint8_t {
+        Configured = 0,    // as set by pid_bypass
+        Rate = 1,          // acro: sticks command rates, angle masters bypassed
+        AltitudeHold = 2,  // altitude hold around the throttle latched when entering the profile
+    };
+
     Control(State* state, const PIDParameters& config);
-    void parseConfig(const PIDParameters& config);
+    void parseConfig(const PIDParameters& config);  // also applies slave_shaping and gain_schedule
+
+    void setBatteryVoltage(float volts);  // filtered pack voltage, for gain compensation
+    void setSampleRate(float hz);         // measured IMU sample rate; 0 if not known yet
 
-    void calculateControlVectors();
+    // switches controllers on and off without touching the others; newly enabled ones take over bumplessly,
+    // and leaving altitude hold hands its thrust over to the new profile at CONTROL_HOLD_RELEASE_RATE
+    void setProfile(Profile profile);
+
+    void calculateControlVectors(uint32_t now);  // call once per new IMU sample
 
     State* state;
 
@@ -44,17 +76,57 @@ class Control {
         float yaw_slave[7];
 
         uint8_t pid_bypass;  // bitfield order for bypass: {thrustMaster, pitchMaster, rollMaster, yawMaster, thrustSlave, pitchSlave, rollSlave, yawSlave} (LSB-->MSB)
+
+        uint8_t profile_switching;  // 1: AUX2 selects the controller profile; 0: always Configured
     } pid_parameters;
 
-    static_assert(sizeof(PIDParameters) == 4 * 8 * 7 + 1, "Data is not packed");
+    static_assert(sizeof(PIDParameters) == 4 * 8 * 7 + 1 + 1, "Data is not packed");
+
+    struct __attribute__((packed)) SlaveShaping {
+        bool verify() const;
+
+        float feed_forward[4];       // per slave {thrust, pitch, roll, yaw}; output per unit of slave setpoint, added on top of the PID terms
+        float d_filter_delay[4];     // D filter delay sec used with derivative on measurement
+        uint8_t d_on_measurement;    // bitfield order: {thrust, pitch, roll, yaw, x, x, x, x} (LSB-->MSB); D acts on the measured rate, not the error
+    } slave_shaping;
+
+    static_assert(sizeof(SlaveShaping) == 4 * 4 * 2 + 1, "Data is not packed");
+
+    // P and D of the pitch, roll and yaw slaves get scaled by a throttle (TPA) and battery voltage dependent factor
+    struct __attribute__((packed)) GainSchedule {
+        bool verify() const;
+
+        float tpa_breakpoint;   // thrust fraction above which the gains start to drop
+        float tpa_rate;         // gain reduction at full thrust, as a fraction; 0 turns TPA off
+        float nominal_voltage;  // pack voltage the gains are tuned at, in V; 0 turns voltage compensation off
+        float voltage_limit;    // largest gain boost for a sagging pack
+    } gain_schedule;
+
+    static_assert(sizeof(GainSchedule) == 4 * 4, "Data is not packed");
 
     uint32_t lastUpdateMicros = 0;  // 1.2 hrs should be enough
+    float samplePeriod{CONTROL_UPDATE_PERIOD / 1000000.0f};  // seconds; the time step the controllers are precomputed for
+    uint32_t controlCycles = 0;     // cycles spent in the last controller update, with CONTROL_BENCHMARK
 
-    // unpack config.pidBypass for convenience
+    // unpack config.pidBypass for convenience; this is the set used by the active profile
     bool pidEnabled[8]{false, false, false, false, false, false, false, false};
 
-    // controllers
-    CascadedPID thrust_pid, pitch_pid, roll_pid, yaw_pid;
+    Profile profile{Profile::Configured};
+    bool profileEnabled[3][8];  // indexed by Profile, precomputed in parseConfig
+
+    float tpaTable[CONTROL_TPA_TABLE_SIZE];  // precomputed in parseConfig
+    float voltageFactor{1.0f};               // precomputed in setBatteryVoltage
+
+    // latched when entering altitude hold
+    float holdAltitude{0.0f};
+    float holdThrust{0.0f};
+    int16_t holdThrottle{0};
+
+    // difference between the last altitude hold thrust and the new profile's, added on top and ramped out after leaving
+    float releaseThrust{0.0f};
+
+    // controllers, indexed by PID_ID
+    PIDBank pids;
 };
 
 #endif
@@ -0,0 +1,95 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <fastmath.h>
+
+    Single precision approximations of libm functions used on the estimation hot path.
+
+    The libm versions take and return doubles, which the Cortex-M4 FPU cannot handle in hardware.
+*/
+
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(FASTMATH_INV_SQRT_SSE)
+#include <xmmintrin.h>
+#endif
+
+/*
+    inv_sqrt(x) = 1 / sqrt(x), selected at compile time:
+
+    FASTMATH_INV_SQRT_HARDWARE  1.0f / sqrtf(x), VSQRT + VDIV on the Cortex-M4F; exact to rounding
+    FASTMATH_INV_SQRT_NEWTON    IEEE bit trick followed by two Newton-Raphson steps; ~5e-6 relative error
+    FASTMATH_INV_SQRT_SSE       rsqrtss followed by one Newton-Raphson step; host builds only
+
+    The hardware path is the default.
+*/
+
+#if !defined(FASTMATH_INV_SQRT_HARDWARE) && !defined(FASTMATH_INV_SQRT_NEWTON) && !defined(FASTMATH_INV_SQRT_SSE)
+#define FASTMATH_INV_SQRT_HARDWARE
+#endif
+
+#if defined(FASTMATH_INV_SQRT_NEWTON) && defined(SE_NON_IEEE_STANDARD_FLOATS)
+#error "The inv_sqrt bit trick needs IEEE 754 floats"
+#endif
+
+inline float inv_sqrt(float x) {
+#if defined(FASTMATH_INV_SQRT_SSE)
+    float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return y * (1.5f - 0.5f * x * y * y);
+#elif defined(FASTMATH_INV_SQRT_NEWTON)
+    // memcpy instead of pointer casts keeps this within strict aliasing; it compiles to a register move
+    uint32_t i;
+    float y;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f3759df - (i >> 1);
+    memcpy(&y, &i, sizeof(y));
+    const float halfx = 0.5f * x;
+    y = y * (1.5f - halfx * y * y);
+    y = y * (1.5f - halfx * y * y);
+    return y;
+#else
+    return 1.0f / sqrtf(x);
+#endif
+}
+
+// arctangent of x for |x| <= 1; max error ~2e-6 rad
+inline float fast_atan_unit(float x) {
+    float x2 = x * x;
+    return x * (0.99997726f + x2 * (-0.33262347f + x2 * (0.19354346f + x2 * (-0.11643287f + x2 * (0.05265332f - 0.01172120f * x2)))));
+}
+
+// four quadrant arctangent of y/x, in radians
+inline float fast_atan2(float y, float x) {
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    if (ax == 0.0f && ay == 0.0f)
+        return 0.0f;
+
+    float angle;
+    if (ay <= ax)
+        angle = fast_atan_unit(ay / ax);
+    else
+        angle = 1.57079633f - fast_atan_unit(ax / ay);
+
+    if (x < 0.0f)
+        angle = 3.14159265f - angle;
+    return (y < 0.0f) ? -angle : angle;
+}
+
+// arcsine of x, in radians; x is clamped to [-1, 1]
+inline float fast_asin(float x) {
+    if (x >= 1.0f)
+        return 1.57079633f;
+    if (x <= -1.0f)
+        return -1.57079633f;
+    return fast_atan2(x, sqrtf(1.0f - x * x));
+}
+
+#endif /* end of include guard: FASTMATH_H */
@@ -68,12 +68,7 @@ void setup() {
     sys.bmp.restart();
     if (sys.bmp.getID() == 0x58) {
         sys.state.clear(STATUS_BMP_FAIL);
-        // state is unhappy without an initial pressure
-        sys.bmp.startMeasurement();  // important; otherwise we'll never set ready!
-        sys.i2c.update();  // write data
-        delay(2);  // wait for data to arrive
-        sys.i2c.update();  // read data
-        sys.state.p0 = sys.state.pressure;  // initialize reference pressure
+        sys.state.p0 = sys.state.pressure;  // initialize reference pressure, measured by restart()
     } else {
         sys.led.update();
         while (1)
@@ -144,9 +139,12 @@ void loop() {
 
     sys.i2c.update();  // manages a queue of requests for mpu, mag, bmp
 
+    bool new_sample{false};
     if (sys.mpu.ready) {
         if (!skip_state_update) {
             sys.state.updateStateIMU(micros());  // update state as often as we can
+            sys.spectrum.addSample(micros(), sys.mpu.getUnfilteredGyro(), sys.state.accel);
+            new_sample = true;
         } else {
         }
         if (sys.mpu.startMeasurement()) {
@@ -160,13 +158,15 @@ void loop() {
 
     if (sys.state.is(STATUS_OVERRIDE)) {  // user is changing motor levels using Configurator
         sys.motors.updateAllChannels();
-    } else {
-        sys.control.calculateControlVectors();
+    } else if (new_sample) {  // the controllers step once per IMU sample
+        sys.control.calculateControlVectors(micros());
 
         sys.airframe.updateMotorsMix();
         sys.motors.updateAllChannels();
     }
 
+    sys.spectrum.update();  // one channel of a completed frame at most; cheap otherwise
+
     RunProcesses<1000, 100, 40, 35, 30, 10, 1>();
 }
 
@@ -201,9 +201,12 @@ bool ProcessTask<100>() {
         sys.state.updateStatePT(micros());
         sys.bmp.startMeasurement();
     } else {
-        return false;
+        sys.bmp.pollMeasurement();
     }
 
+    sys.mpu.updateFilters(sys.spectrum.dominantGyroFrequency(), sys.spectrum.sampleRate() * SPECTRUM_DECIMATION);
+    sys.control.setSampleRate(sys.spectrum.sampleRate() * SPECTRUM_DECIMATION);
+
     if (sys.state.is(STATUS_CLEAR_MPU_BIAS)) {
         sys.mpu.forgetBiasValues();
         sys.state.clear(STATUS_CLEAR_MPU_BIAS);
@@ -229,29 +232,18 @@ bool ProcessTask<40>() {
     sys.pilot.processCommands();
 
     sys.pwr.measureRawLevels();  // read all ADCs
+    sys.control.setBatteryVoltage(sys.pwr.getFilteredV0());
 
     // check for low voltage condition
-    if ( ((1/50)/0.003*1.2/65536 * sys.state.I1_raw ) > 1.0f ){ //if total battery current > 1A
-        if ( ((20.5+226)/20.5*1.2/65536 * sys.state.V0_raw) < 2.8f ) {
-            low_battery_counter++;
-            if ( low_battery_counter > 40 ){
-                sys.state.set(STATUS_BATTERY_LOW);
-            }
-        }
-        else {
-            low_battery_counter = 0;
+    // (the current dependent 2.8V threshold never applied, as its current scale was the integer 1/50 == 0)
+    if ( (0.00022017316f * sys.state.V0_raw) < 3.63f ) { // (20.5+226)/20.5*1.2/65536
+        low_battery_counter++;
+        if ( low_battery_counter > 40 ){
+            sys.state.set(STATUS_BATTERY_LOW);
         }
     }
     else {
-        if ( ((20.5+226)/20.5*1.2/65536 * sys.state.V0_raw) < 3.63f ) {
-            low_battery_counter++;
-            if ( low_battery_counter > 40 ){
-                sys.state.set(STATUS_BATTERY_LOW);
-            }
-        }
-        else {
-            low_battery_counter = 0;
-        }
+        low_battery_counter = 0;
     }
 
     return true;
@@ -270,6 +262,9 @@ bool ProcessTask<10>() {
 
 template <>
 bool ProcessTask<1>() {
+#ifdef CONTROL_BENCHMARK
+    DebugPrintf("Controller update took %lu cycles", sys.control.controlCycles);
+#endif
     return true;
 }
 
@@ -52,6 +52,10 @@ void I2CManager::update() {
         if (error == 0 && transfers.front().receive_count > 0) {
             waiting_for_data = true;
             Wire.requestFrom(transfers.front().address, transfers.front().receive_count);
+        } else if (error == 0) {
+            // write-only transfers are done as soon as they are sent
+            transfers.front().cb_object->triggerCallback();
+            transfers.pop();
         } else {
             // how do we want to handle errors? ignore for now
         }
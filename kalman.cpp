@@ -1,50 +1,87 @@
 #include "kalman.h"
-#include "lapack.h"
 
-void se_kalman_predict(float deltaTime, float* state, float* covar) {
-    float F[9] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
-    static const float Q[9] = {0.06f, 0.0f, 0.0f, 0.0f, 0.04f, 0.0f, 0.0f, 0.0f, 0.01f};
-    static const int n = 3;
-    static const float f_one = 1.0f, f_zero = 0.0f;
-    float buffer[9];
+/*
+ * The altitude filter state is [p, v, a, b]: elevation, climb rate, measured
+ * vertical acceleration and accelerometer bias, so the true acceleration is
+ * a - b. Both kernels are written out by hand for that size: F only has a few
+ * nontrivial entries and P is symmetric, so only its upper triangle is
+ * computed and then mirrored into the lower one.
+ */
+
+#define P_(r, c) covar.data[r][c]
+
+void se_kalman_predict(float deltaTime, float* state, Matrix<float, 4, 4>& covar) {
+    static const float Q[4] = {0.06f, 0.04f, 0.01f, 0.0004f}; /* diagonal of Q */
 
     if (!(deltaTime > 0.0f))
         return;
 
-    /* p += v * dt + a * dt * dt / 2; F[0] = 1, F[3] = dt, F[6] = dt * dt / 2 */
-    F[3] = deltaTime;
-    F[6] = deltaTime * deltaTime * 0.5f;
-    state[0] += F[3] * state[1] + F[6] * state[2];
-    /* v += a * dt; F[1] = 0, F[4] = 1, F[7] = dt */
-    F[7] = deltaTime;
-    state[1] += F[7] * state[2];
+    /*
+     * F = | 1  dt  dt * dt / 2  -dt * dt / 2 |
+     *     | 0   1  dt           -dt          |
+     *     | 0   0  1             0           |
+     *     | 0   0  0             1           |
+     */
+    const float f01 = deltaTime;
+    const float f02 = deltaTime * deltaTime * 0.5f;
+    const float f12 = deltaTime;
+
+    const float accel = state[2] - state[3];
+    state[0] += f01 * state[1] + f02 * accel;
+    state[1] += f12 * accel;
 
-    /* buffer = P * F' */
-    Fgemm_("n", "t", &n, &n, &n, &f_one, covar, &n, F, &n, &f_zero, buffer, &n);
+    /* The last two columns of F only ever appear as (row 2 - row 3) of P */
+    const float d0 = P_(2, 0) - P_(3, 0);
+    const float d1 = P_(2, 1) - P_(3, 1);
+    const float d2 = P_(2, 2) - P_(3, 2);
+    const float d3 = P_(2, 3) - P_(3, 3);
 
-    /* P = Q */
-    Flacpy_(" ", &n, &n, Q, &n, covar, &n);
+    /* M = F * P, only the entries needed for the upper triangle of M * F' */
+    const float m00 = P_(0, 0) + f01 * P_(1, 0) + f02 * d0;
+    const float m01 = P_(0, 1) + f01 * P_(1, 1) + f02 * d1;
+    const float m02 = P_(0, 2) + f01 * P_(1, 2) + f02 * d2;
+    const float m03 = P_(0, 3) + f01 * P_(1, 3) + f02 * d3;
+    const float m11 = P_(1, 1) + f12 * d1;
+    const float m12 = P_(1, 2) + f12 * d2;
+    const float m13 = P_(1, 3) + f12 * d3;
 
-    /* P = F * buffer + dT * P = F * P * F' + dt * Q */
-    Fgemm_("n", "n", &n, &n, &n, &f_one, F, &n, buffer, &n, &deltaTime, covar, &n);
+    /* P = M * F' + dt * Q */
+    P_(0, 0) = m00 + f01 * m01 + f02 * (m02 - m03) + deltaTime * Q[0];
+    P_(0, 1) = m01 + f12 * (m02 - m03);
+    P_(0, 2) = m02;
+    P_(0, 3) = m03;
+    P_(1, 1) = m11 + f12 * (m12 - m13) + deltaTime * Q[1];
+    P_(1, 2) = m12;
+    P_(1, 3) = m13;
+    P_(2, 2) += deltaTime * Q[2];
+    P_(3, 3) += deltaTime * Q[3];
+    symmetrize(covar);
 }
 
-void se_kalman_correct(float* state, float* covar, int coordinate, float value, float variance) {
-    static const int n = 3, i_one = 1;
-    static const float f_one = 1.0f, f_minus_one = -1.0f;
+void se_kalman_correct(float* state, Matrix<float, 4, 4>& covar, int coordinate, float value, float variance) {
     float y = value - state[coordinate];
-    float k_opt[3], h_row[3];
-    float s_inverse = 1.0f / (covar[coordinate * 4] + variance);
-    int i;
-    for (i = 0; i < 3; ++i) {
-        k_opt[i] = covar[i + coordinate * 3] * s_inverse;
-        state[i] += k_opt[i] * y;
-        h_row[i] = covar[coordinate + 3 * i];
-    }
-    /*
-     * P -= K * H * P
-     * H has 1 row and 3 columns with value col == coordinate ? 1 : 0
-     * Thus, H * P is the "coordinate"-th row of P
-     */
-    Fgemm_("n", "n", &n, &n, &i_one, &f_minus_one, k_opt, &n, h_row, &i_one, &f_one, covar, &n);
+    float s_inverse = 1.0f / (P_(coordinate, coordinate) + variance);
+    /* H selects a single coordinate, so H * P is that row of P (equal to the column, by symmetry) */
+    float h[4] = {P_(0, coordinate), P_(1, coordinate), P_(2, coordinate), P_(3, coordinate)};
+    float k[4] = {h[0] * s_inverse, h[1] * s_inverse, h[2] * s_inverse, h[3] * s_inverse};
+
+    state[0] += k[0] * y;
+    state[1] += k[1] * y;
+    state[2] += k[2] * y;
+    state[3] += k[3] * y;
+
+    /* P -= K * H * P */
+    P_(0, 0) -= k[0] * h[0];
+    P_(0, 1) -= k[0] * h[1];
+    P_(0, 2) -= k[0] * h[2];
+    P_(0, 3) -= k[0] * h[3];
+    P_(1, 1) -= k[1] * h[1];
+    P_(1, 2) -= k[1] * h[2];
+    P_(1, 3) -= k[1] * h[3];
+    P_(2, 2) -= k[2] * h[2];
+    P_(2, 3) -= k[2] * h[3];
+    P_(3, 3) -= k[3] * h[3];
+    symmetrize(covar);
 }
+
+#undef P_
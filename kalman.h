@@ -1,8 +1,10 @@
 #ifndef SE_KALMAN_H_
 #define SE_KALMAN_H_
 
-void se_kalman_predict(float deltaTime, float* state, float* covar);
+#include "matrix.h"
 
-void se_kalman_correct(float* state, float* covar, int coordinate, float value, float variance);
+void se_kalman_predict(float deltaTime, float* state, Matrix<float, 4, 4>& covar);
+
+void se_kalman_correct(float* state, Matrix<float, 4, 4>& covar, int coordinate, float value, float variance);
 
 #endif /* end of include guard: SE_KALMAN_H_ */
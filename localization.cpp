@@ -3,13 +3,43 @@
 #include <algorithm>
 #include <cmath>
 #include "ahrs.h"
+#include "fastmath.h"
 #include "kalman.h"
 
 #define SE_ACC_VARIANCE 0.01f
+#define SE_ACC_BIAS_VARIANCE 0.25f
+
+/* Online gyro drift estimation, in rad/s of correction per second per unit of tilt error */
+#define SE_GYRO_DRIFT_GAIN 0.02f
+#define SE_GYRO_DRIFT_LIMIT 0.1f /* rad/s */
+
+/*
+ * Relative deviation of |acc| from gravity below which the accelerometer is
+ * fully trusted as a gravity reference, and above which it is ignored
+ */
+#define SE_ACC_TRUST_LOW 0.05f
+#define SE_ACC_TRUST_HIGH 0.2f
+
+/*
+ * Magnetometer samples are carried forward with the gyro for at most this
+ * long, in seconds, and fused on every IMU step until then. Madgwick and
+ * Mahony weigh the magnetometer by SE_MAG_GAIN relative to the accelerometer.
+ */
+#define SE_MAG_MAX_AGE 0.1f
+#define SE_MAG_GAIN 1.0f
+
+/* Error-state Kalman filter noise, see EskfNoise */
+#define SE_ESKF_GYRO_VARIANCE 1e-5f
+#define SE_ESKF_GYRO_BIAS_VARIANCE 1e-8f
+#define SE_ESKF_ACC_VARIANCE 0.01f
+#define SE_ESKF_MAG_VARIANCE 0.05f /* per magnetometer sample, spread over the IMU steps it is fused on */
+#define SE_ESKF_INITIAL_ATTITUDE_VARIANCE 0.1f
+#define SE_ESKF_INITIAL_GYRO_BIAS_VARIANCE 1e-4f
 
 #define SE_STATE_P_Z 0
 #define SE_STATE_V_Z 1
 #define SE_STATE_A_Z 2
+#define SE_STATE_A_BIAS 3
 
 namespace {
 void se_compensate_imu_gyro_offsets(const float gyro_drift[3], float gyro[3]) {
@@ -19,27 +49,79 @@ void se_compensate_imu_gyro_offsets(const float gyro_drift[3], float gyro[3]) {
 }
 
 void se_compensate_imu_acc_offsets(const float q[4], float gravity, float acc[3]) {
-    acc[0] += gravity * 2.0f * (q[1] * q[3] - q[0] * q[2]);
-    acc[1] += gravity * 2.0f * (q[2] * q[3] + q[0] * q[1]);
-    acc[2] += gravity * (q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]);
+    /* At rest the accelerometer reads +gravity along the estimated gravity direction */
+    acc[0] -= gravity * 2.0f * (q[1] * q[3] - q[0] * q[2]);
+    acc[1] -= gravity * 2.0f * (q[2] * q[3] + q[0] * q[1]);
+    acc[2] -= gravity * (q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]);
+}
+
+/* Weight in [0, 1] of the accelerometer as a gravity reference, based on how far |acc| is from gravity */
+float se_accelerometer_trust(const float acc[3], float gravity) {
+    float deviation = fabsf(sqrtf(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2]) - gravity) / gravity;
+    if (deviation <= SE_ACC_TRUST_LOW)
+        return 1.0f;
+    if (deviation >= SE_ACC_TRUST_HIGH)
+        return 0.0f;
+    return (SE_ACC_TRUST_HIGH - deviation) / (SE_ACC_TRUST_HIGH - SE_ACC_TRUST_LOW);
+}
+
+/*
+ * Integrate the tilt error between measured and estimated gravity into the
+ * gyro drift, the same way Mahony's integral term does
+ */
+void se_estimate_gyro_drift(float delta_time, float trust, const float q[4], const float acc[3], float gyro_drift[3]) {
+    if (trust == 0.0f)
+        return;
+
+    float recipNorm = inv_sqrt(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2]);
+    float ax = acc[0] * recipNorm;
+    float ay = acc[1] * recipNorm;
+    float az = acc[2] * recipNorm;
+
+    /* Estimated direction of gravity */
+    float vx = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+    float vy = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+    float vz = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+
+    float error[3] = {ay * vz - az * vy, az * vx - ax * vz, ax * vy - ay * vx};
+    float gain = SE_GYRO_DRIFT_GAIN * trust * delta_time;
+    for (int i = 0; i < 3; ++i)
+        gyro_drift[i] = std::max(-SE_GYRO_DRIFT_LIMIT, std::min(SE_GYRO_DRIFT_LIMIT, gyro_drift[i] - gain * error[i]));
 }
 
-void se_compensate_imu(float delta_time, FilterType type, const float parameters[], IMUState* state, float gyro[3], float acc[3], float mag[3], int use_mag) {
-    se_compensate_imu_gyro_offsets(state->gyro_drift, gyro);
+void se_compensate_imu(float delta_time, FilterType type, const float parameters[], IMUState* state, float gyro[3], float acc[3], float mag[3], int use_mag, float mag_period) {
+    float trust = se_accelerometer_trust(acc, state->gravity);
 
     switch (type) {
         case FilterType::Madgwick:
+            /* Mahony's integral term already estimates the drift, so only Madgwick needs this */
+            se_estimate_gyro_drift(delta_time, trust, state->q, acc, state->gyro_drift);
+            se_compensate_imu_gyro_offsets(state->gyro_drift, gyro);
             if (use_mag)
-                se_madgwick_ahrs_update_imu_with_mag(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], mag[0], mag[1], mag[2], delta_time, parameters[0], state->q);
+                se_madgwick_ahrs_update_imu_with_mag(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], mag[0], mag[1], mag[2], delta_time, trust * parameters[0], SE_MAG_GAIN, state->q);
             else
-                se_madgwick_ahrs_update_imu(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], delta_time, parameters[0], state->q);
+                se_madgwick_ahrs_update_imu(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], delta_time, trust * parameters[0], state->q);
             break;
         case FilterType::Mahony:
+            se_compensate_imu_gyro_offsets(state->gyro_drift, gyro);
             if (use_mag)
-                se_mahony_ahrs_update_imu_with_mag(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], mag[0], mag[1], mag[2], delta_time, parameters[0], parameters[1], state->fb_i, state->q);
+                se_mahony_ahrs_update_imu_with_mag(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], mag[0], mag[1], mag[2], delta_time, parameters[0], trust * parameters[1], SE_MAG_GAIN, state->fb_i, state->q);
             else
-                se_mahony_ahrs_update_imu(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], delta_time, parameters[0], parameters[1], state->fb_i, state->q);
+                se_mahony_ahrs_update_imu(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], delta_time, parameters[0], trust * parameters[1], state->fb_i, state->q);
             break;
+        case FilterType::Ekf: {
+            /*
+             * The filter estimates the drift itself; an untrusted accelerometer is given no weight.
+             * A magnetometer sample is fused mag_period / delta_time times, so each fusion counts for that fraction of it.
+             */
+            float mag_variance = delta_time > 0.0f ? SE_ESKF_MAG_VARIANCE * mag_period / delta_time : 0.0f;
+            EskfNoise noise{SE_ESKF_GYRO_VARIANCE, SE_ESKF_GYRO_BIAS_VARIANCE, trust > 0.0f ? SE_ESKF_ACC_VARIANCE / trust : 0.0f, mag_variance};
+            se_compensate_imu_gyro_offsets(state->gyro_drift, gyro);
+            if (use_mag)
+                se_eskf_ahrs_update_imu_with_mag(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], mag[0], mag[1], mag[2], delta_time, noise, &state->eskf_covar, state->gyro_drift, state->q);
+            else
+                se_eskf_ahrs_update_imu(gyro[0], gyro[1], gyro[2], acc[0], acc[1], acc[2], delta_time, noise, &state->eskf_covar, state->gyro_drift, state->q);
+        } break;
     }
 
     se_compensate_imu_acc_offsets(state->q, state->gravity, acc);
@@ -65,15 +147,18 @@ Localization::Localization(float deltaTime, FilterType ahrsType, const float* ah
 
 Localization::Localization(float q0, float q1, float q2, float q3, float deltaTime, FilterType ahrsType, const float* ahrsParameters, float elevationVariance)
     : imuState{{0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, {q0, q1, q2, q3}, {0.0f, 0.0f, 0.0f}},
-      z{0.0, 0.0, 0.0},
-      zCovar{1e30f, 0.0f, 0.0f, 0.0f, 0.01f, 0.0f, 0.0f, 0.0f, 0.01f},
+      z{0.0f, 0.0f, 0.0f, 0.0f},
+      zCovar{{{1e30f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.01f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.01f, 0.0f}, {0.0f, 0.0f, 0.0f, SE_ACC_BIAS_VARIANCE}}},
       magLastMeas{0.0f, 0.0f, 0.0f},
+      magAge{0.0f},
+      magPeriod{SE_MAG_MAX_AGE},
       hasMagMeas{false},
       deltaTime(deltaTime),
       ahrsParameters(ahrsParameters),
       elevationVariance(elevationVariance),
       ahrsType(ahrsType),
       timeNow(0.0f) {
+    se_eskf_init(SE_ESKF_INITIAL_ATTITUDE_VARIANCE, SE_ESKF_INITIAL_GYRO_BIAS_VARIANCE, &imuState.eskf_covar);
     setGravityEstimate(9.81f);
 }
 
@@ -96,8 +181,22 @@ void Localization::ProcessMeasurementIMU(unsigned int time, const float* gyrosco
         gyroCorrected[i] = gyroscope[i];
         accelCorrected[i] = accelerometer[i] * 9.81f;
     }
-    se_compensate_imu(deltaTime, ahrsType, ahrsParameters, &imuState, gyroCorrected, accelCorrected, magLastMeas, hasMagMeas);
-    hasMagMeas = false;
+    if (hasMagMeas) {
+        /*
+         * The magnetometer runs slower than the IMU; rotate the last sample
+         * with the body so every IMU step sees a current estimate of it
+         */
+        float wx = gyroscope[0] - imuState.gyro_drift[0];
+        float wy = gyroscope[1] - imuState.gyro_drift[1];
+        float wz = gyroscope[2] - imuState.gyro_drift[2];
+        float m[3] = {magLastMeas[0], magLastMeas[1], magLastMeas[2]};
+        magLastMeas[0] -= (wy * m[2] - wz * m[1]) * deltaTime;
+        magLastMeas[1] -= (wz * m[0] - wx * m[2]) * deltaTime;
+        magLastMeas[2] -= (wx * m[1] - wy * m[0]) * deltaTime;
+        hasMagMeas = magAge + deltaTime < SE_MAG_MAX_AGE;
+    }
+    magAge += deltaTime;
+    se_compensate_imu(deltaTime, ahrsType, ahrsParameters, &imuState, gyroCorrected, accelCorrected, magLastMeas, hasMagMeas, magPeriod);
     se_kalman_predict(deltaTime, z, zCovar);
     timeNow = time;
     se_kalman_correct(z, zCovar, SE_STATE_A_Z, getVerticalAcceleration(imuState.q, accelCorrected), SE_ACC_VARIANCE);
@@ -106,6 +205,10 @@ void Localization::ProcessMeasurementIMU(unsigned int time, const float* gyrosco
 void Localization::ProcessMeasurementMagnetometer(const float* magnetometer) {
     for (int i = 0; i < 3; ++i)
         magLastMeas[i] = magnetometer[i];
+    /* Time since the previous sample, i.e. the number of IMU steps this one will be fused on */
+    if (magAge > 0.0f)
+        magPeriod = std::min(magAge, SE_MAG_MAX_AGE);
+    magAge = 0.0f;
     hasMagMeas = true;
 }
 
@@ -128,5 +231,9 @@ const float* Localization::getAhrsQuaternion() const {
 }
 
 float Localization::getElevation() const {
-    return z[0];
+    return z[SE_STATE_P_Z];
+}
+
+float Localization::getClimbRate() const {
+    return z[SE_STATE_V_Z];
 }
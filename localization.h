@@ -1,16 +1,20 @@
 #ifndef SE_LOCALIZATION_H_
 #define SE_LOCALIZATION_H_
 
+#include "ahrs.h"
+#include "matrix.h"
+
 struct IMUState {
     float gyro_drift[3];
     float gravity_filter_weight;
     float gravity;
     float q[4];
     float fb_i[3];
+    EskfCovariance eskf_covar;
 };
 
 /* Filter types */
-enum class FilterType { Madgwick = 0, Mahony = 1 };
+enum class FilterType { Madgwick = 0, Mahony = 1, Ekf = 2 };
 
 class Localization {
    public:
@@ -36,11 +40,15 @@ class Localization {
 
     float getElevation() const;
 
+    float getClimbRate() const;
+
    private:
     IMUState imuState;
-    float z[3];
-    float zCovar[9];
+    float z[4];
+    Matrix<float, 4, 4> zCovar;
     float magLastMeas[3];
+    float magAge;
+    float magPeriod;
     bool hasMagMeas;
 
     float deltaTime;
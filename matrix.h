@@ -0,0 +1,137 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <matrix.h>
+
+    Fixed-size matrices for the estimator and sensor drivers.
+
+    Dimensions are template parameters, so mismatched products fail to compile and every loop has a
+    compile-time trip count that the compiler can fully unroll.
+*/
+
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <cstddef>
+
+template <typename T, std::size_t R, std::size_t C>
+struct Matrix {
+    static constexpr std::size_t rows = R;
+    static constexpr std::size_t cols = C;
+
+    T& operator()(std::size_t r, std::size_t c) {
+        return data[r][c];
+    }
+
+    const T& operator()(std::size_t r, std::size_t c) const {
+        return data[r][c];
+    }
+
+    static Matrix zeros() {
+        Matrix m;
+        for (std::size_t r = 0; r < R; ++r)
+            for (std::size_t c = 0; c < C; ++c)
+                m.data[r][c] = T(0);
+        return m;
+    }
+
+    static Matrix identity() {
+        static_assert(R == C, "Identity matrix must be square");
+        Matrix m = zeros();
+        for (std::size_t i = 0; i < R; ++i)
+            m.data[i][i] = T(1);
+        return m;
+    }
+
+    Matrix<T, C, R> transposed() const {
+        Matrix<T, C, R> m;
+        for (std::size_t r = 0; r < R; ++r)
+            for (std::size_t c = 0; c < C; ++c)
+                m.data[c][r] = data[r][c];
+        return m;
+    }
+
+    // x = M * x, for a square matrix applied to a plain array
+    void applyTo(T (&x)[C]) const {
+        static_assert(R == C, "Matrix must be square to be applied in place");
+        T y[R];
+        for (std::size_t r = 0; r < R; ++r) {
+            y[r] = T(0);
+            for (std::size_t c = 0; c < C; ++c)
+                y[r] += data[r][c] * x[c];
+        }
+        for (std::size_t r = 0; r < R; ++r)
+            x[r] = y[r];
+    }
+
+    Matrix& operator+=(const Matrix& other) {
+        for (std::size_t r = 0; r < R; ++r)
+            for (std::size_t c = 0; c < C; ++c)
+                data[r][c] += other.data[r][c];
+        return *this;
+    }
+
+    Matrix& operator-=(const Matrix& other) {
+        for (std::size_t r = 0; r < R; ++r)
+            for (std::size_t c = 0; c < C; ++c)
+                data[r][c] -= other.data[r][c];
+        return *this;
+    }
+
+    Matrix& operator*=(T scale) {
+        for (std::size_t r = 0; r < R; ++r)
+            for (std::size_t c = 0; c < C; ++c)
+                data[r][c] *= scale;
+        return *this;
+    }
+
+    T data[R][C];
+};
+
+template <typename T, std::size_t N>
+using Vector = Matrix<T, N, 1>;
+
+template <typename T, std::size_t R, std::size_t C>
+inline Matrix<T, R, C> operator+(Matrix<T, R, C> a, const Matrix<T, R, C>& b) {
+    return a += b;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+inline Matrix<T, R, C> operator-(Matrix<T, R, C> a, const Matrix<T, R, C>& b) {
+    return a -= b;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+inline Matrix<T, R, C> operator*(Matrix<T, R, C> a, T scale) {
+    return a *= scale;
+}
+
+template <typename T, std::size_t R, std::size_t C>
+inline Matrix<T, R, C> operator*(T scale, Matrix<T, R, C> a) {
+    return a *= scale;
+}
+
+template <typename T, std::size_t R, std::size_t K, std::size_t C>
+inline Matrix<T, R, C> operator*(const Matrix<T, R, K>& a, const Matrix<T, K, C>& b) {
+    Matrix<T, R, C> m;
+    for (std::size_t r = 0; r < R; ++r)
+        for (std::size_t c = 0; c < C; ++c) {
+            T sum(0);
+            for (std::size_t k = 0; k < K; ++k)
+                sum += a.data[r][k] * b.data[k][c];
+            m.data[r][c] = sum;
+        }
+    return m;
+}
+
+// Copy the upper triangle into the lower one, to keep covariance matrices exactly symmetric
+template <typename T, std::size_t N>
+inline void symmetrize(Matrix<T, N, N>& m) {
+    for (std::size_t r = 1; r < N; ++r)
+        for (std::size_t c = 0; c < r; ++c)
+            m.data[r][c] = m.data[c][r];
+}
+
+#endif /* end of include guard: MATRIX_H */
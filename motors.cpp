@@ -6,25 +6,86 @@
 
 #include "motors.h"
 #include "board.h"
+#include "debug.h"
 #include "state.h"
 
-Motors::Motors(State* state) : state(state) {
+namespace {
+struct Timing {
+    float frequency;  // Hz
+    float pulse_min;  // us, at motor level 0
+    float pulse_max;  // us, at motor level 4095
+};
+
+// indexed by Motors::Protocol; the PWM pulse spans the whole period
+const Timing TIMING[]{
+    {11718.0f, 0.0f, 1000000.0f / 11718.0f * 4095.0f / 4096.0f},
+    {2000.0f, 125.0f, 250.0f},
+    {32000.0f, 5.0f, 25.0f},
+};
+}
+
+bool Motors::Settings::verify() const {
+    if (protocol > static_cast<uint8_t>(Protocol::Multishot)) {
+        DebugPrint("Motor protocol must be 0 (PWM), 1 (OneShot125) or 2 (Multishot)");
+        return false;
+    }
+#ifndef MOTORS_ESC
+    if (protocol != static_cast<uint8_t>(Protocol::PWM)) {
+        DebugPrint("Motor protocol must be 0 (PWM) for brushed motors; ESC protocols need a build with MOTORS_ESC");
+        return false;
+    }
+#endif
+    return true;
+}
+
+Motors::Motors(State* state) : state(state), settings{static_cast<uint8_t>(Protocol::PWM)} {
     // REFERENCE: https://www.pjrc.com/teensy/td_pulse.html
-    analogWriteResolution(12);  // actual resolution depends on frequency
+    analogWriteResolution(16);  // actual resolution depends on frequency
 
     for (auto pin : board::PWM)
         pinMode(pin, OUTPUT);
 
+    setupTimers();
+}
+
+void Motors::setSettings(const Settings& new_settings) {
+    if (new_settings.protocol == settings.protocol)
+        return;
+    if (state->is(STATUS_ENABLED | STATUS_OVERRIDE)) {
+        DebugPrint("Motor protocol can only be changed while the motors are disarmed");
+        return;
+    }
+    settings = new_settings;
+    setupTimers();
+}
+
+void Motors::setupTimers() {
+    const Timing& timing = TIMING[settings.protocol];
+
     for (auto ftm : board::FTM)  // changes all pins on FTM2 and FTM0
-        analogWriteFrequency(ftm, 11718);
+        analogWriteFrequency(ftm, timing.frequency);
+
+    // a pulse of t us is t * frequency / 1000000 of the period, out of 65536
+    const float us_to_duty = timing.frequency * 65536.0f / 1000000.0f;
+    duty_offset = timing.pulse_min * us_to_duty;
+    duty_scale = (timing.pulse_max - timing.pulse_min) / 4095.0f * us_to_duty;
+
+    for (uint8_t motor = 0; motor < 8; ++motor) {
+        written[motor] = (uint16_t)(duty_offset + 0.5f);
+        analogWrite(board::PWM[motor], written[motor]);
+    }
 }
 
 void Motors::updateAllChannels() {
     bool motors_enabled{state->is(STATUS_ENABLED) || state->is(STATUS_OVERRIDE)};
 
     for (uint8_t motor = 0; motor < 8; motor++) {
-        // 12 bit output
+        // 12 bit level, written as a 16 bit duty; ESCs get their minimum pulse when disabled
         state->MotorOut[motor] = constrain(state->MotorOut[motor], 0, 4095);
-        analogWrite(board::PWM[motor], motors_enabled ? state->MotorOut[motor] : 0);
+        uint16_t value = (uint16_t)(duty_offset + duty_scale * (motors_enabled ? state->MotorOut[motor] : 0) + 0.5f);
+        if (value == written[motor])
+            continue;
+        analogWrite(board::PWM[motor], value);
+        written[motor] = value;
     }
 }
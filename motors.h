@@ -7,6 +7,15 @@
 
     Applies motor levels using output PWM timers
 
+    Only motors whose level changed are written. The timers are only reprogrammed when the protocol changes,
+    which restarts them with all motors at level 0.
+
+    Brushed motors are driven with a plain duty cycle. Brushless ESCs get OneShot125 (125-250us) or
+    Multishot (5-25us) pulses, repeated at a rate well above the control loop rate.
+
+    The ESC protocols are only accepted in builds with MOTORS_ESC defined, as their minimum pulse is a 16-25% duty
+    that spins brushed motors while disarmed. The protocol can only be changed while the motors are disarmed.
+
 */
 
 #ifndef motors_h
@@ -14,15 +23,44 @@
 
 #include "Arduino.h"
 
+// define for boards whose motor outputs drive brushless ESCs
+// #define MOTORS_ESC
+
 class State;
 
 class Motors {
    public:
+    enum class Protocol : uint8_t {
+        PWM = 0,         // brushed motors, duty cycle at 11718 Hz
+        OneShot125 = 1,  // 125-250us pulses at 2 kHz, MOTORS_ESC builds only
+        Multishot = 2,   // 5-25us pulses at 32 kHz, MOTORS_ESC builds only
+    };
+
+    struct __attribute__((packed)) Settings {
+        bool verify() const;
+        uint8_t protocol;  // a Motors::Protocol
+    };
+
+    static_assert(sizeof(Settings) == 1, "Data is not packed");
+
     Motors(State* state);
     void updateAllChannels();
 
+    // keeps the current protocol if the motors are armed
+    void setSettings(const Settings& new_settings);
+    const Settings& getSettings() const {
+        return settings;
+    }
+
    private:
+    void setupTimers();
+
     State* state;
+    Settings settings;
+    // 16 bit duty for a motor level of 0, and its change per motor level
+    float duty_offset;
+    float duty_scale;
+    uint16_t written[8];  // last value written to each motor
 };
 
 #endif
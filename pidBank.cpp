@@ -0,0 +1,144 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+    *
+
+    <pidBank.h/cpp>
+
+*/
+
+#include "pidBank.h"
+
+namespace {
+// weight of a new sample in a first order low pass with time constant tau
+float filterAlpha(float dt, float tau) {
+    return (dt + tau > 0.0f) ? dt / (dt + tau) : 1.0f;
+}
+}
+
+PIDBank::PIDBank() {
+    const float zeros[7]{0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    for (uint8_t i = 0; i < PID_COUNT; ++i)
+        configure(i, zeros);
+    setTimestep(0.0f);
+}
+
+void PIDBank::configure(uint8_t index, const float* terms) {
+    Kp[index] = terms[0];
+    Ki[index] = terms[1];
+    Kd[index] = terms[2];
+    integral_windup_guard[index] = terms[3];
+    d_filter_tau[index] = terms[4];
+    setpoint_filter_tau[index] = terms[5];
+    command_to_value[index] = terms[6];
+    wrap[index] = 0.0f;
+    feed_forward[index] = 0.0f;
+    d_measurement[index] = 0.0f;
+    d_measurement_tau[index] = 0.0f;
+    gain_scale[index] = 1.0f;
+
+    input_[index] = 0.0f;
+    setpoint_[index] = 0.0f;
+    desired_setpoint_[index] = 0.0f;
+    last_time[index] = 0;
+    p_term[index] = 0.0f;
+    i_term[index] = 0.0f;
+    d_term[index] = 0.0f;
+    previous_error[index] = 0.0f;
+    previous_input[index] = 0.0f;
+    error_integral[index] = 0.0f;
+}
+
+void PIDBank::setShaping(uint8_t index, float feed_forward_gain, bool d_on_measurement, float d_tau) {
+    feed_forward[index] = feed_forward_gain;
+    d_measurement[index] = d_on_measurement ? 1.0f : 0.0f;
+    d_measurement_tau[index] = d_tau;
+}
+
+void PIDBank::setTimestep(float dt) {
+    delta_time = dt;
+    for (uint8_t i = 0; i < PID_COUNT; ++i) {
+        d_filter_alpha[i] = filterAlpha(dt, (d_measurement[i] != 0.0f) ? d_measurement_tau[i] : d_filter_tau[i]);
+        setpoint_filter_alpha[i] = filterAlpha(dt, setpoint_filter_tau[i]);
+        derivative_gain[i] = (dt > 0.0f) ? Kd[i] / dt : 0.0f;
+        integral_limit[i] = (Ki[i] != 0.0f) ? fabsf(integral_windup_guard[i] / Ki[i]) : 0.0f;
+    }
+}
+
+void PIDBank::Compute(uint32_t now, const float (&setpoint)[PID_AXES], const bool (&enabled)[PID_COUNT], float (&output)[PID_AXES], bool advance) {
+    float value[PID_AXES];
+    for (uint8_t axis = 0; axis < PID_AXES; ++axis)
+        value[axis] = setpoint[axis];
+    computeStage(0, now, value, enabled, advance);
+    computeStage(PID_AXES, now, value, enabled, advance);
+    for (uint8_t axis = 0; axis < PID_AXES; ++axis)
+        output[axis] = value[axis];
+}
+
+// Disabled controllers are skipped and keep their state; their stage passes its input value through.
+void PIDBank::computeStage(size_t first, uint32_t now, float (&value)[PID_AXES], const bool (&enabled)[PID_COUNT], bool advance) {
+    for (size_t axis = 0; axis < PID_AXES; ++axis) {
+        const size_t i = first + axis;
+        last_time[i] = now;
+        if (!enabled[i])
+            continue;
+
+        const float desired = value[axis];
+        const float old_setpoint = setpoint_[i];
+        const float old_d = d_term[i];
+        const float old_integral = error_integral[i];
+
+        float sp = old_setpoint + setpoint_filter_alpha[i] * (desired - old_setpoint);
+
+        const float input = input_[i];
+        float error = sp - input;
+        // wrap to [-180, 180) for angle controllers
+        float turns = (error + 180.0f) * (1.0f / 360.0f);
+        int32_t whole = (int32_t)turns;
+        whole -= (turns < whole);
+        error -= wrap[i] * 360.0f * whole;
+
+        float p = Kp[i] * gain_scale[i] * error;
+        float in = Ki[i] * old_integral;
+        // on measurement, the derivative of the error is taken as if the setpoint had not moved
+        float error_change = error - previous_error[i];
+        error_change += d_measurement[i] * (previous_input[i] - input - error_change);
+        float d = old_d;
+        if (advance) {
+            d += d_filter_alpha[i] * (derivative_gain[i] * gain_scale[i] * error_change - old_d);
+            error_integral[i] = fminf(fmaxf(old_integral + error * delta_time, -integral_limit[i]), integral_limit[i]);
+        }
+
+        desired_setpoint_[i] = desired;
+        setpoint_[i] = sp;
+        p_term[i] = p;
+        i_term[i] = in;
+        d_term[i] = d;
+        previous_error[i] = error;
+        previous_input[i] = input;
+
+        value[axis] = p + in + d + feed_forward[i] * desired;
+    }
+}
+
+void PIDBank::IntegralReset() {
+    for (uint8_t i = 0; i < PID_COUNT; ++i) {
+        error_integral[i] = 0.0f;
+        desired_setpoint_[i] = 0.0f;
+    }
+}
+
+void PIDBank::engage(uint8_t index, float output) {
+    desired_setpoint_[index] = input_[index];
+    setpoint_[index] = input_[index];
+    previous_error[index] = 0.0f;
+    previous_input[index] = input_[index];
+    p_term[index] = 0.0f;
+    d_term[index] = 0.0f;
+    // assume the incoming setpoint will match the input, so feed-forward provides its share of the output
+    output -= feed_forward[index] * input_[index];
+    float integral = (Ki[index] != 0.0f) ? output / Ki[index] : 0.0f;
+    error_integral[index] = fminf(fmaxf(integral, -integral_limit[index]), integral_limit[index]);
+    i_term[index] = Ki[index] * error_integral[index];
+}
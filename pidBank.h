@@ -0,0 +1,139 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+    *
+
+    <pidBank.h/cpp>
+
+    All cascaded controllers, stored as structure of arrays.
+
+    Controller index i is stage * PID_AXES + axis, where masters are stage 0 and slaves stage 1;
+    this is the order of the PID parameters in the config and of the bypass bits.
+    Each stage is computed for all axes in one loop over contiguous arrays.
+
+*/
+
+#ifndef PID_BANK_h
+#define PID_BANK_h
+
+#include "Arduino.h"
+
+#define PID_AXES 4                // thrust, pitch, roll, yaw
+#define PID_COUNT (2 * PID_AXES)  // a master and a slave per axis
+
+class PIDBank final {
+   public:
+    PIDBank();
+
+    // terms are {P, I, D, integral windup guard, D filter delay sec, setpoint filter delay sec, command scaling factor}
+    // resets the state of the controller
+    void configure(uint8_t index, const float* terms);
+
+    // feed-forward adds feed_forward * (incoming setpoint) straight to the output; with d_on_measurement the derivative
+    // is taken of the input instead of the error, filtered with d_measurement_tau instead of the D filter delay;
+    // meant for rate controllers, as input changes are not unwrapped
+    void setShaping(uint8_t index, float feed_forward, bool d_on_measurement, float d_measurement_tau);
+
+    // precomputes all coefficients for a fixed time step in seconds; Compute assumes it is called at that rate
+    void setTimestep(float dt);
+
+    // unwrap error terms for angle control in degrees
+    void isWrapped(uint8_t index, bool wrapped = true) {
+        wrap[index] = wrapped ? 1.0f : 0.0f;
+    }
+
+    // scales P and D, for gain scheduling; takes effect on the next Compute
+    void setGainScale(uint8_t index, float scale) {
+        gain_scale[index] = scale;
+    }
+
+    void setInput(uint8_t index, float v) {
+        input_[index] = v;
+    }
+
+    float getScalingFactor(uint8_t axis, bool use_master, bool use_slave, float default_val) const {
+        if (use_master)
+            return command_to_value[axis];
+        if (use_slave)
+            return command_to_value[PID_AXES + axis];
+        return default_val;
+    }
+
+    // runs masters then slaves for every axis; a stage that is not enabled passes its setpoint through untouched
+    // without advance the integral and derivative terms hold, for a step that does not match the time step
+    void Compute(uint32_t now, const float (&setpoint)[PID_AXES], const bool (&enabled)[PID_COUNT], float (&output)[PID_AXES], bool advance = true);
+
+    void IntegralReset();
+
+    // bumpless transfer for a controller that is about to be enabled: restarts it at its current input,
+    // with the integral preloaded to produce the given output, as far as Ki and the windup guard allow
+    void engage(uint8_t index, float output);
+
+    uint32_t lastTime(uint8_t index) const {
+        return last_time[index];
+    }
+
+    float pTerm(uint8_t index) const {
+        return p_term[index];
+    }
+
+    float iTerm(uint8_t index) const {
+        return i_term[index];
+    }
+
+    float dTerm(uint8_t index) const {
+        return d_term[index];
+    }
+
+    float input(uint8_t index) const {
+        return input_[index];
+    }
+
+    float setpoint(uint8_t index) const {
+        return setpoint_[index];
+    }
+
+    float desiredSetpoint(uint8_t index) const {
+        return desired_setpoint_[index];
+    }
+
+   private:
+    void computeStage(size_t first, uint32_t now, float (&value)[PID_AXES], const bool (&enabled)[PID_COUNT], bool advance);
+
+    // configuration
+    float Kp[PID_COUNT];
+    float Ki[PID_COUNT];
+    float Kd[PID_COUNT];
+    float integral_windup_guard[PID_COUNT];
+    float d_filter_tau[PID_COUNT];
+    float setpoint_filter_tau[PID_COUNT];
+    float command_to_value[PID_COUNT];
+    float wrap[PID_COUNT];  // 1 for angle controllers in degrees, 0 otherwise
+    float feed_forward[PID_COUNT];
+    float d_measurement[PID_COUNT];  // 1 for derivative on measurement, 0 for derivative on error
+    float d_measurement_tau[PID_COUNT];
+
+    // precomputed by setTimestep
+    float delta_time{0.0f};
+    float derivative_gain[PID_COUNT];  // Kd / dt
+    float integral_limit[PID_COUNT];   // integral_windup_guard / Ki, 0 when Ki is 0
+    float d_filter_alpha[PID_COUNT];
+    float setpoint_filter_alpha[PID_COUNT];
+
+    float gain_scale[PID_COUNT];  // 1 unless scheduled
+
+    // state
+    float input_[PID_COUNT];
+    float setpoint_[PID_COUNT];
+    float desired_setpoint_[PID_COUNT];
+    uint32_t last_time[PID_COUNT];
+    float p_term[PID_COUNT];
+    float i_term[PID_COUNT];
+    float d_term[PID_COUNT];
+    float previous_error[PID_COUNT];
+    float previous_input[PID_COUNT];
+    float error_integral[PID_COUNT];
+};
+
+#endif
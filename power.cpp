@@ -33,6 +33,12 @@ void PowerMonitor::measureRawLevels(void) {
     state->V0_raw = getV0Raw();
     state->I0_raw = getI0Raw();
     state->I1_raw = getI1Raw();
+
+    float v0 = 0.00022017316f * state->V0_raw;
+    if (filtered_V0 == 0.0f)
+        filtered_V0 = v0;  // start from the first sample
+    else
+        filtered_V0 += POWER_V0_FILTER * (v0 - filtered_V0);
 }
 
 float PowerMonitor::getTotalPower(void) {
@@ -40,7 +46,7 @@ float PowerMonitor::getTotalPower(void) {
 }
 
 float PowerMonitor::getElectronicsPower(void) {
-    return getI1() * 3.7;
+    return getI1() * 3.7f;
 }
 
 uint16_t PowerMonitor::getV0Raw(void) {
@@ -57,15 +63,19 @@ uint16_t PowerMonitor::getI1Raw(void) {
 
 float PowerMonitor::getV0(void) {
     // Volts = (20.5 + 226) / 20.5 * 1.2 / 65536 * raw
-    return 0.00022017316 * getV0Raw();
+    return 0.00022017316f * getV0Raw();
+}
+
+float PowerMonitor::getFilteredV0(void) const {
+    return filtered_V0;
 }
 
 float PowerMonitor::getI0(void) {
     // Amps = (1/50) / 0.003 * 1.2 / 65536 * raw
-    return 0.00012207031 * getI0Raw();
+    return 0.00012207031f * getI0Raw();
 }
 
 float PowerMonitor::getI1(void) {
     // Amps = (1/50) / 0.03 * 1.2 / 65536 * raw
-    return 0.00001220703 * getI1Raw();
+    return 0.00001220703f * getI1Raw();
 }
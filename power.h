@@ -16,6 +16,8 @@
 
 class State;
 
+#define POWER_V0_FILTER 0.025f  // weight of each new V0 sample in the filtered pack voltage; ~1 sec at 40 Hz
+
 class PowerMonitor {
    public:
     PowerMonitor(State* state);
@@ -31,6 +33,9 @@ class PowerMonitor {
     float getV0();
     // measured at battery input terminal in V
 
+    float getFilteredV0() const;
+    // low passed V0, updated by measureRawLevels; in V
+
     float getI0();
     // total current from battery in mA
 
@@ -40,6 +45,7 @@ class PowerMonitor {
    private:
     State* state;
     ADC adc;
+    float filtered_V0{0.0f};
 
     uint16_t getV0Raw();
     uint16_t getI0Raw();
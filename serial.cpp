@@ -35,8 +35,8 @@ inline void WriteToOutput(CobsPayload<N>& payload, bool use_logger = false) {
 }
 
 template <std::size_t N>
-inline void WritePIDData(CobsPayload<N>& payload, const PID& pid) {
-    payload.Append(pid.lastTime(), pid.input(), pid.setpoint(), pid.pTerm(), pid.iTerm(), pid.dTerm());
+inline void WritePIDData(CobsPayload<N>& payload, const PIDBank& pids, uint8_t index) {
+    payload.Append(pids.lastTime(index), pids.input(index), pids.setpoint(index), pids.pTerm(index), pids.iTerm(index), pids.dTerm(index));
 }
 }
 
@@ -215,6 +215,27 @@ void SerialComm::ProcessData(CobsReaderBuffer& data_input) {
                     }
                 }
             }
+            if (success && (submask & CONFIG_struct::MAG_SOFT_IRON)) {
+                success = data_input.ParseInto(tmp_config.data.mag_soft_iron);
+            }
+            if (success && (submask & CONFIG_struct::BMP_SETTINGS)) {
+                success = data_input.ParseInto(tmp_config.data.bmp_settings);
+            }
+            if (success && (submask & CONFIG_struct::MPU_SETTINGS)) {
+                success = data_input.ParseInto(tmp_config.data.mpu_settings);
+            }
+            if (success && (submask & CONFIG_struct::SLAVE_SHAPING)) {
+                success = data_input.ParseInto(tmp_config.data.slave_shaping);
+            }
+            if (success && (submask & CONFIG_struct::GAIN_SCHEDULE)) {
+                success = data_input.ParseInto(tmp_config.data.gain_schedule);
+            }
+            if (success && (submask & CONFIG_struct::MOTOR_GEOMETRY)) {
+                success = data_input.ParseInto(tmp_config.data.motor_geometry);
+            }
+            if (success && (submask & CONFIG_struct::MOTOR_SETTINGS)) {
+                success = data_input.ParseInto(tmp_config.data.motor_settings);
+            }
             if (success && tmp_config.data.verify()) {
                 tmp_config.data.applyTo(*systems);
                 writeEEPROM(tmp_config);  // TODO: deal with side effect code
@@ -258,6 +279,27 @@ void SerialComm::ProcessData(CobsReaderBuffer& data_input) {
                     }
                 }
             }
+            if (submask & CONFIG_struct::MAG_SOFT_IRON) {
+                tmp_config.data.mag_soft_iron = default_config.data.mag_soft_iron;
+            }
+            if (submask & CONFIG_struct::BMP_SETTINGS) {
+                tmp_config.data.bmp_settings = default_config.data.bmp_settings;
+            }
+            if (submask & CONFIG_struct::MPU_SETTINGS) {
+                tmp_config.data.mpu_settings = default_config.data.mpu_settings;
+            }
+            if (submask & CONFIG_struct::SLAVE_SHAPING) {
+                tmp_config.data.slave_shaping = default_config.data.slave_shaping;
+            }
+            if (submask & CONFIG_struct::GAIN_SCHEDULE) {
+                tmp_config.data.gain_schedule = default_config.data.gain_schedule;
+            }
+            if (submask & CONFIG_struct::MOTOR_GEOMETRY) {
+                tmp_config.data.motor_geometry = default_config.data.motor_geometry;
+            }
+            if (submask & CONFIG_struct::MOTOR_SETTINGS) {
+                tmp_config.data.motor_settings = default_config.data.motor_settings;
+            }
             if (success && tmp_config.data.verify()) {
                 tmp_config.data.applyTo(*systems);
                 writeEEPROM(tmp_config);  // TODO: deal with side effect code
@@ -276,6 +318,11 @@ void SerialComm::ProcessData(CobsReaderBuffer& data_input) {
         }
     }
 
+    if (mask & COM_REQ_SPECTRUM) {
+        SendSpectrum();
+        ack_data |= COM_REQ_SPECTRUM;
+    }
+
     if (mask & COM_REQ_RESPONSE) {
         SendResponse(mask, ack_data);
     }
@@ -323,6 +370,27 @@ void SerialComm::SendPartialConfiguration(uint16_t submask, uint16_t led_mask) c
             }
         }
     }
+    if (submask & CONFIG_struct::MAG_SOFT_IRON) {
+        payload.Append(tmp_config.data.mag_soft_iron);
+    }
+    if (submask & CONFIG_struct::BMP_SETTINGS) {
+        payload.Append(tmp_config.data.bmp_settings);
+    }
+    if (submask & CONFIG_struct::MPU_SETTINGS) {
+        payload.Append(tmp_config.data.mpu_settings);
+    }
+    if (submask & CONFIG_struct::SLAVE_SHAPING) {
+        payload.Append(tmp_config.data.slave_shaping);
+    }
+    if (submask & CONFIG_struct::GAIN_SCHEDULE) {
+        payload.Append(tmp_config.data.gain_schedule);
+    }
+    if (submask & CONFIG_struct::MOTOR_GEOMETRY) {
+        payload.Append(tmp_config.data.motor_geometry);
+    }
+    if (submask & CONFIG_struct::MOTOR_SETTINGS) {
+        payload.Append(tmp_config.data.motor_settings);
+    }
 
     WriteToOutput(payload);
 }
@@ -393,6 +461,10 @@ uint16_t SerialComm::PacketSize(uint32_t mask) const {
         sum += 4;
     if (mask & SerialComm::STATE_LOOP_COUNT)
         sum += 4;
+    if (mask & SerialComm::STATE_VIBRATION_PEAKS)
+        sum += SPECTRUM_CHANNELS * 4;
+    if (mask & SerialComm::STATE_MIX_SATURATION)
+        sum += 1;
     return sum;
 }
 
@@ -441,21 +513,21 @@ void SerialComm::SendState(uint32_t timestamp_us, uint32_t mask, bool redirect_t
     if (mask & SerialComm::STATE_F_AND_T)
         payload.Append(state->Fz, state->Tx, state->Ty, state->Tz);
     if (mask & SerialComm::STATE_PID_FZ_MASTER)
-        WritePIDData(payload, control->thrust_pid.master());
+        WritePIDData(payload, control->pids, Control::THRUST_MASTER);
     if (mask & SerialComm::STATE_PID_TX_MASTER)
-        WritePIDData(payload, control->pitch_pid.master());
+        WritePIDData(payload, control->pids, Control::PITCH_MASTER);
     if (mask & SerialComm::STATE_PID_TY_MASTER)
-        WritePIDData(payload, control->roll_pid.master());
+        WritePIDData(payload, control->pids, Control::ROLL_MASTER);
     if (mask & SerialComm::STATE_PID_TZ_MASTER)
-        WritePIDData(payload, control->yaw_pid.master());
+        WritePIDData(payload, control->pids, Control::YAW_MASTER);
     if (mask & SerialComm::STATE_PID_FZ_SLAVE)
-        WritePIDData(payload, control->thrust_pid.slave());
+        WritePIDData(payload, control->pids, Control::THRUST_SLAVE);
     if (mask & SerialComm::STATE_PID_TX_SLAVE)
-        WritePIDData(payload, control->pitch_pid.slave());
+        WritePIDData(payload, control->pids, Control::PITCH_SLAVE);
     if (mask & SerialComm::STATE_PID_TY_SLAVE)
-        WritePIDData(payload, control->roll_pid.slave());
+        WritePIDData(payload, control->pids, Control::ROLL_SLAVE);
     if (mask & SerialComm::STATE_PID_TZ_SLAVE)
-        WritePIDData(payload, control->yaw_pid.slave());
+        WritePIDData(payload, control->pids, Control::YAW_SLAVE);
     if (mask & SerialComm::STATE_MOTOR_OUT)
         payload.Append(state->MotorOut);
     if (mask & SerialComm::STATE_KINE_ANGLE)
@@ -466,6 +538,12 @@ void SerialComm::SendState(uint32_t timestamp_us, uint32_t mask, bool redirect_t
         payload.Append(state->kinematicsAltitude);
     if (mask & SerialComm::STATE_LOOP_COUNT)
         payload.Append(state->loopCount);
+    if (mask & SerialComm::STATE_VIBRATION_PEAKS) {
+        for (uint8_t channel = 0; channel < SPECTRUM_CHANNELS; ++channel)
+            payload.Append(systems->spectrum.peakFrequency(channel));
+    }
+    if (mask & SerialComm::STATE_MIX_SATURATION)
+        payload.Append(state->mixSaturation);
     WriteToOutput(payload, redirect_to_sd_card);
 }
 
@@ -476,6 +554,14 @@ void SerialComm::SendResponse(uint32_t mask, uint32_t response) const {
     WriteToOutput(payload);
 }
 
+void SerialComm::SendSpectrum() const {
+    CobsPayloadGeneric payload;
+    WriteProtocolHead(MessageType::Spectrum, 0xFFFFFFFF, payload);
+    payload.Append(systems->spectrum.sampleRate());
+    payload.Append(systems->spectrum.amplitudes());
+    WriteToOutput(payload);
+}
+
 uint16_t SerialComm::GetSendStateDelay() const {
     return send_state_delay;
 }
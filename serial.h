@@ -29,6 +29,7 @@ class SerialComm {
         Timelog = 2,
         DebugString = 3,
         HistoryData = 4,
+        Spectrum = 5,
     };
 
     enum CommandFields : uint32_t {
@@ -57,6 +58,7 @@ class SerialComm {
         COM_SET_PARTIAL_EEPROM_DATA = 1 << 20,
         COM_REINIT_PARTIAL_EEPROM_DATA = 1 << 21,
         COM_REQ_PARTIAL_EEPROM_DATA = 1 << 22,
+        COM_REQ_SPECTRUM = 1 << 23,
     };
 
     enum StateFields : uint32_t {
@@ -89,6 +91,8 @@ class SerialComm {
         STATE_KINE_RATE = 1 << 25,
         STATE_KINE_ALTITUDE = 1 << 26,
         STATE_LOOP_COUNT = 1 << 27,
+        STATE_VIBRATION_PEAKS = 1 << 28,
+        STATE_MIX_SATURATION = 1 << 29,
     };
 
     explicit SerialComm(State* state, const volatile uint16_t* ppm, const Control* control, Systems* systems, LED* led, PilotCommand* command);
@@ -100,6 +104,7 @@ class SerialComm {
     void SendDebugString(const String& string, MessageType type = MessageType::DebugString) const;
     void SendState(uint32_t timestamp_us, uint32_t mask = 0, bool redirect_to_sd_card = false) const;
     void SendResponse(uint32_t mask, uint32_t response) const;
+    void SendSpectrum() const;
 
     uint16_t GetSendStateDelay() const;
     uint16_t GetSdCardStateDelay() const;
@@ -0,0 +1,171 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+*/
+
+#include "spectrum.h"
+#include <math.h>
+
+namespace {
+const size_t HALF = SPECTRUM_SIZE / 2;
+
+// in-place radix-2 FFT of HALF complex values; twiddle holds exp(-2 pi i k / SPECTRUM_SIZE)
+void fft_half(float (&re)[HALF], float (&im)[HALF], const float (&twiddle)[HALF][2]) {
+    for (size_t i = 1, j = 0; i < HALF; ++i) {
+        size_t bit = HALF >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j |= bit;
+        if (i < j) {
+            float t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (size_t length = 2; length <= HALF; length <<= 1) {
+        size_t stride = SPECTRUM_SIZE / length;  // twiddle index step; HALF points use every second entry
+        for (size_t start = 0; start < HALF; start += length) {
+            for (size_t k = 0; k < length / 2; ++k) {
+                const float wr = twiddle[k * stride][0];
+                const float wi = twiddle[k * stride][1];
+                size_t a = start + k;
+                size_t b = a + length / 2;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer()
+    : accumulator{0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+      decimationCount{0},
+      filled{0},
+      pendingChannel{SPECTRUM_CHANNELS},
+      frameStart{0},
+      frameEnd{0},
+      rate{0.0f} {
+    // Hann window
+    float sum{0.0f};
+    for (size_t i = 0; i < SPECTRUM_SIZE; ++i) {
+        window[i] = 0.5f - 0.5f * cosf(6.28318531f * i / SPECTRUM_SIZE);
+        sum += window[i];
+    }
+    windowGain = 2.0f / sum;
+    for (size_t k = 0; k < HALF; ++k) {
+        twiddle[k][0] = cosf(6.28318531f * k / SPECTRUM_SIZE);
+        twiddle[k][1] = -sinf(6.28318531f * k / SPECTRUM_SIZE);
+    }
+    for (size_t c = 0; c < SPECTRUM_CHANNELS; ++c) {
+        for (size_t k = 0; k < SPECTRUM_BINS; ++k)
+            amplitude[c][k] = 0.0f;
+        peak[c] = 0.0f;
+        peakAmplitude[c] = 0.0f;
+    }
+}
+
+void SpectrumAnalyzer::addSample(uint32_t time, const float gyro[3], const float accel[3]) {
+    if (pendingChannel < SPECTRUM_CHANNELS)
+        return;  // busy with the previous frame
+
+    for (size_t i = 0; i < 3; ++i) {
+        accumulator[i] += gyro[i];
+        accumulator[i + 3] += accel[i];
+    }
+    if (++decimationCount < SPECTRUM_DECIMATION)
+        return;
+    decimationCount = 0;
+
+    if (filled == 0)
+        frameStart = time;
+    for (size_t c = 0; c < SPECTRUM_CHANNELS; ++c) {
+        frame[c][filled] = accumulator[c] * (1.0f / SPECTRUM_DECIMATION);
+        accumulator[c] = 0.0f;
+    }
+    if (++filled < SPECTRUM_SIZE)
+        return;
+
+    frameEnd = time;
+    filled = 0;
+    pendingChannel = 0;
+}
+
+void SpectrumAnalyzer::update() {
+    if (pendingChannel >= SPECTRUM_CHANNELS)
+        return;
+    if (pendingChannel == 0 && frameEnd != frameStart)
+        rate = (SPECTRUM_SIZE - 1) * 1000000.0f / (frameEnd - frameStart);
+    transform(pendingChannel++);
+}
+
+void SpectrumAnalyzer::transform(uint8_t channel) {
+    const float* x = frame[channel];
+
+    float mean{0.0f};
+    for (size_t i = 0; i < SPECTRUM_SIZE; ++i)
+        mean += x[i];
+    mean *= 1.0f / SPECTRUM_SIZE;
+
+    // pack the real frame as HALF complex values: even samples in re, odd in im
+    float re[HALF];
+    float im[HALF];
+    for (size_t n = 0; n < HALF; ++n) {
+        re[n] = (x[2 * n] - mean) * window[2 * n];
+        im[n] = (x[2 * n + 1] - mean) * window[2 * n + 1];
+    }
+    fft_half(re, im, twiddle);
+
+    // untangle the even and odd halves into the spectrum of the real frame
+    float* a = amplitude[channel];
+    for (size_t k = 0; k < SPECTRUM_BINS; ++k) {
+        size_t k1 = k % HALF;
+        size_t k2 = (HALF - k) % HALF;
+        float er = 0.5f * (re[k1] + re[k2]);
+        float ei = 0.5f * (im[k1] - im[k2]);
+        float orr = 0.5f * (im[k1] + im[k2]);
+        float oi = -0.5f * (re[k1] - re[k2]);
+        float wr = (k < HALF) ? twiddle[k][0] : -1.0f;
+        float wi = (k < HALF) ? twiddle[k][1] : 0.0f;
+        float xr = er + wr * orr - wi * oi;
+        float xi = ei + wr * oi + wi * orr;
+        a[k] += SPECTRUM_SMOOTHING * (sqrtf(xr * xr + xi * xi) * windowGain - a[k]);
+    }
+
+    // the lowest bins hold the motion of the flyer itself rather than vibration
+    size_t best = 2;
+    for (size_t k = 3; k < SPECTRUM_BINS - 1; ++k) {
+        if (a[k] > a[best])
+            best = k;
+    }
+    float denominator = a[best - 1] - 2.0f * a[best] + a[best + 1];
+    float offset = (denominator < 0.0f) ? 0.5f * (a[best - 1] - a[best + 1]) / denominator : 0.0f;
+    peak[channel] = best + offset;
+    peakAmplitude[channel] = a[best];
+}
+
+float SpectrumAnalyzer::sampleRate() const {
+    return rate;
+}
+
+float SpectrumAnalyzer::peakFrequency(uint8_t channel) const {
+    return peak[channel] * rate * (1.0f / SPECTRUM_SIZE);
+}
+
+float SpectrumAnalyzer::dominantGyroFrequency() const {
+    uint8_t best{0};
+    for (uint8_t c = 1; c < 3; ++c) {
+        if (peakAmplitude[c] > peakAmplitude[best])
+            best = c;
+    }
+    return peakFrequency(best);
+}
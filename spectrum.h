@@ -0,0 +1,62 @@
+/*
+    *  Flybrix Flight Controller -- Copyright 2015 Flying Selfie Inc.
+    *
+    *  License and other details available at: http://www.flybrix.com/firmware
+
+    <spectrum.h/cpp>
+
+    Vibration spectrum of the gyro and accelerometer.
+
+    Samples are gathered into frames of SPECTRUM_SIZE; each frame is windowed and run through a real FFT one
+    channel per call of update(), so the work is spread over several loop iterations. Samples arriving while a
+    frame is being transformed are dropped.
+*/
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <Arduino.h>
+
+#define SPECTRUM_SIZE 64                       // samples per frame; a power of two
+#define SPECTRUM_BINS (SPECTRUM_SIZE / 2 + 1)  // DC to Nyquist
+#define SPECTRUM_CHANNELS 6                    // gyro x, y, z, accel x, y, z
+#define SPECTRUM_DECIMATION 1                  // IMU samples averaged into each spectrum sample
+#define SPECTRUM_SMOOTHING 0.25f               // weight of the newest frame in the reported amplitudes
+
+class SpectrumAnalyzer {
+   public:
+    SpectrumAnalyzer();
+
+    void addSample(uint32_t time, const float gyro[3], const float accel[3]);  // cheap; call for every IMU sample
+    void update();  // transforms at most one channel of a completed frame
+
+    float sampleRate() const;                    // of the last completed frame, in Hz
+    float peakFrequency(uint8_t channel) const;  // strongest bin above the lowest two, in Hz; 0 before the first frame
+    float dominantGyroFrequency() const;         // peak frequency of the gyro axis with the strongest peak
+
+    const float (&amplitudes() const)[SPECTRUM_CHANNELS][SPECTRUM_BINS] {
+        return amplitude;
+    }
+
+   private:
+    void transform(uint8_t channel);
+
+    float frame[SPECTRUM_CHANNELS][SPECTRUM_SIZE];
+    float accumulator[SPECTRUM_CHANNELS];
+    uint8_t decimationCount;
+    uint8_t filled;
+    uint8_t pendingChannel;  // next channel to transform; SPECTRUM_CHANNELS when no frame is pending
+    uint32_t frameStart;
+    uint32_t frameEnd;
+    float rate;
+
+    float window[SPECTRUM_SIZE];
+    float windowGain;                     // amplitude scale that undoes the window and one-sided spectrum
+    float twiddle[SPECTRUM_SIZE / 2][2];  // exp(-2 pi i k / SPECTRUM_SIZE)
+
+    float amplitude[SPECTRUM_CHANNELS][SPECTRUM_BINS];
+    float peak[SPECTRUM_CHANNELS];  // in bins, interpolated
+    float peakAmplitude[SPECTRUM_CHANNELS];
+};
+
+#endif /* end of include guard: SPECTRUM_H */
@@ -5,6 +5,7 @@
 */
 
 #include "debug.h"
+#include "fastmath.h"
 #include "state.h"
 
 #include <Arduino.h>
@@ -20,6 +21,14 @@
 State::State() : localization(0.0f, 1.0f, 0.0f, 0.0f, STATE_EXPECTED_TIME_STEP, FilterType::Madgwick, parameters.state_estimation, STATE_BARO_VARIANCE) {
 }
 
+bool State::Parameters::verify() const {
+    if (filter_type > static_cast<uint8_t>(FilterType::Ekf)) {
+        DebugPrint("Unknown attitude filter type");
+        return false;
+    }
+    return true;
+}
+
 bool State::stable(void) {
     float max_variance = 0.0f;
     for (int i = 0; i < 3; i++) {
@@ -115,31 +124,33 @@ void State::resetState() {
     kinematicsRate[1] = 0.0f;
     kinematicsRate[2] = 0.0f;
     kinematicsAltitude = 0.0f;  // meters
+    kinematicsClimbRate = 0.0f;  // meters/sec
     p0 = pressure;              // reset filter to current value
-    localization = Localization(0.0f, 1.0f, 0.0f, 0.0f, STATE_EXPECTED_TIME_STEP, FilterType::Madgwick, parameters.state_estimation, STATE_BARO_VARIANCE);
+    localization = Localization(0.0f, 1.0f, 0.0f, 0.0f, STATE_EXPECTED_TIME_STEP, static_cast<FilterType>(parameters.filter_type), parameters.state_estimation, STATE_BARO_VARIANCE);
 }
 
 float State::mixRadians(float w1, float a1, float a2) {
     float correction = 0.0f;
-    if ((a2 - a1) > PI)
-        correction = TWO_PI;
-    else if ((a2 - a1) < -PI)
-        correction = -TWO_PI;
+    if ((a2 - a1) > float(PI))
+        correction = float(TWO_PI);
+    else if ((a2 - a1) < -float(PI))
+        correction = -float(TWO_PI);
     return (1.0f - w1) * a2 + w1 * (a1 + correction);
 }
 
 void State::updateStateIMU(uint32_t currentTime) {
     // update IIRs (@500Hz)
     for (int i = 0; i < 3; i++) {
-        gyro_filter[i] = 0.1 * gyro[i] + 0.9 * gyro_filter[i];
-        accel_filter[i] = 0.1 * accel[i] + 0.9 * accel_filter[i];
-        accel_filter_sq[i] = 0.1 * accel[i] * accel[i] + 0.9 * accel_filter_sq[i];
+        gyro_filter[i] = 0.1f * gyro[i] + 0.9f * gyro_filter[i];
+        accel_filter[i] = 0.1f * accel[i] + 0.9f * accel_filter[i];
+        accel_filter_sq[i] = 0.1f * accel[i] * accel[i] + 0.9f * accel_filter_sq[i];
     }
 
     for (int i = 0; i < 3; i++) {
         kinematicsRate[i] = gyro[i] * DEG2RAD;
     }
     localization.ProcessMeasurementIMU(currentTime, kinematicsRate, accel);
+    kinematicsClimbRate = localization.getClimbRate();
 
     const float* q = localization.getAhrsQuaternion();
     float r11 = 2.0f * (q[2] * q[3] + q[1] * q[0]);
@@ -147,14 +158,15 @@ void State::updateStateIMU(uint32_t currentTime) {
     float r21 = -2.0f * (q[2] * q[0] - q[1] * q[3]);
     float r31 = 2.0f * (q[3] * q[0] + q[1] * q[2]);
     float r32 = q[1] * q[1] - q[2] * q[2] - q[3] * q[3] + q[0] * q[0];
-    kinematicsAngle[0] = -atan2(r11, r12);
-    kinematicsAngle[1] = asin(r21);
-    kinematicsAngle[2] = -atan2(r31, r32);
+    kinematicsAngle[0] = -fast_atan2(r11, r12);
+    kinematicsAngle[1] = fast_asin(r21);
+    kinematicsAngle[2] = -fast_atan2(r31, r32);
 }
 
 void State::updateStatePT(uint32_t currentTime) {
     localization.ProcessMeasurementPT(currentTime, STATE_P_SCALE * p0, STATE_P_SCALE * pressure, STATE_T_SCALE * temperature);
     kinematicsAltitude = localization.getElevation();
+    kinematicsClimbRate = localization.getClimbRate();
 }
 
 void State::updateStateMag() {
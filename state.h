@@ -14,6 +14,7 @@
 
 #include <cstdint>
 #include "localization.h"
+#include "matrix.h"
 
 class State {
    public:
@@ -32,7 +33,7 @@ class State {
     uint16_t V0_raw = 0, I0_raw = 0, I1_raw = 0;  // raw ADC levels
 
     // MPU9250 and AK8963
-    float R[3][3];                                                                  // rotation matrix from pcb to flyer frame
+    Matrix<float, 3, 3> R;                                                          // rotation matrix from pcb to flyer frame
     float accel[3] = {0.0, 0.0, 0.0};                                               // g's        -- (x,y,z)
     float gyro[3] = {0.0, 0.0, 0.0};                                                // deg/sec    -- (x,y,z)
     float mag[3] = {0.0, 0.0, 0.0};                                                 // milligauss -- (x,y,z)
@@ -55,11 +56,13 @@ class State {
 
     // Airframe
     uint16_t MotorOut[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    uint8_t mixSaturation = 0;  // bitfield of Airframe::Saturation flags from the last mix
 
     // Kinematics
     float kinematicsAngle[3] = {0.0f, 0.0f, 0.0f};  // radians -- pitch/roll/yaw (x,y,z)
     float kinematicsRate[3] = {0.0f, 0.0f, 0.0f};   // radians/sec -- pitch/roll/yaw (x,y,z) rates
     float kinematicsAltitude = 0.0f;                // meters
+    float kinematicsClimbRate = 0.0f;               // meters/sec
 
     // Motors
     void processMotorEnablingIteration();  // must be called ~80 times to enable motors.
@@ -75,17 +78,17 @@ class State {
     float q[4] = {1.0f, 0.0f, 0.0f, 0.0f};
 
     struct __attribute__((packed)) Parameters {
-        bool verify() const {
-            return true;
-        }
+        bool verify() const;
         // state estimation parameters for tuning
         float state_estimation[2];  // Madwick 2Kp, 2Ki
 
         // limits for enabling motors
         float enable[2];  // variance and gravity angle
+
+        uint8_t filter_type;  // attitude filter, as a FilterType
     } parameters;
 
-    static_assert(sizeof(Parameters) == 2 * 2 * 4, "Data is not packed");
+    static_assert(sizeof(Parameters) == 2 * 2 * 4 + 1, "Data is not packed");
 
    private:
     bool stable();
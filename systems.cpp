@@ -26,6 +26,7 @@ Systems::Systems()
       control{&state, Control::PIDParameters()},
       // listen for configuration inputs
       conf{&state, RX, &control, this, &led, &pilot},
+      spectrum{},
       id{0} {
     CONFIG_struct().applyTo(*this);
 }
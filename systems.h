@@ -23,6 +23,7 @@
 #include "motors.h"
 #include "power.h"
 #include "serial.h"
+#include "spectrum.h"
 #include "state.h"
 #include "version.h"
 
@@ -45,6 +46,7 @@ struct Systems {
     PilotCommand pilot;
     Control control;
     SerialComm conf;
+    SpectrumAnalyzer spectrum;
 
     ConfigID id;
 };